@@ -9,6 +9,7 @@
 # See <http://creativecommons.org/publicdomain/zero/1.0/>.
 
 import math
+import os
 import sys
 import pandas as pd 
 
@@ -70,6 +71,14 @@ files = [
 	["MCG-128-128", 0],
 ]
 
+# Candidates with known problems in high dimension, shared with ../src/gensel.cpp
+blacklist = { "LCG": set(), "MCG": set() }
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "blacklist.txt")) as f:
+    for line in f:
+        if line.strip():
+            t, h = line.split()
+            blacklist[t].add(h)
+
 for p in files:
 
     file = p[0] + "-L"
@@ -90,12 +99,7 @@ for p in files:
     # Filter away candidates below the lag threshold
     data = data[data['L₈'] >= lag_threshold]
     # Discard candidates with know problems in high dimension
-    s = (
-            set(["0x738f6e765", "0xe264473d4e90bb31d", "0x719bb1e7f56883e5d", "0x1da2e4605", "0x1e5e536a3711bc7755", "0x1f3ad22e4bd1a692d", "0x3ad59455e2c68e647d", "0x3e0d997a645f176dd", "0x67c4de5a048ebff1d", "0x728917326ee7fe425", "0x7c87460e5", "0x87338161ef95", "0x87ea3de194dd2e97074f3d0c2ea63d35", "0xb4d13225", "0xc1be9eb68e95", "0xc35bd29e4b5db7ff6d", "0xc478db86929909e45", "0xc8a0bcbd37f06521c5", "0xca7592823d4c35535", "0xddb80b9ccb1066bee495", "0xee3599ad", "0xef78d07615711c7d", "0xf8d79515e58138fd", "0xfaf00a25", "0xfe2d84b0671aa6f869bd", "0xff2826ad","0xee3599ad"])
-            if p[0][:3] == "LCG"
-            else set(["0xee3cc725", "0xe6dccdea3cce7675", "0xf43855c5", "0xcb2dc73bb3a3e8765", "0x1c8134a55f3b9968d", "0x1e5daed42b68e08645", "0x1fa661a55", "0x31e2d", "0x35328ed0d", "0x365b6a2e27d09e2fd", "0x3782c32a82c5dbf4f5", "0x3d30df295", "0x3ea015695", "0x689a0e46d", "0x71217c8b506a03245", "0x78eead14469fc5733d", "0x79f0d", "0x82c1fcad", "0x83b5b142866da9d5", "0xa5c68ce1b17d", "0xaa7a0cf56782fcf5", "0xae36bfb5", "0xae3cc725", "0xc2c1fcad", "0xc3a77d", "0xc7fb6d", "0xe6fd44dd", "0xecbce6ad", "0xed126c68193f2a63846d", "0xee36bfb5", "0xef33769d", "0xf06747158d1be36d", "0xf5ec16ed", "0xf6473f07ba5d", "0xf6ff3eae6408c3dd7d", "0xf7540ec5", "0xf97d5a195ad7c421d","0xaf33769d"])
-        )
-
+    s = blacklist[p[0][:3]]
     data = data[~data['h'].isin(s)]
 
     lowerm = data['M₈'].quantile(.999)
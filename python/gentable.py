@@ -0,0 +1,40 @@
+#!/usr/bin/python3
+
+#  Written in 2021 by Sebastiano Vigna
+#
+# To the extent possible under law, the author has dedicated all copyright
+# and related and neighboring rights to this software to the public domain
+# worldwide. This software is distributed without any warranty.
+#
+# See <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+# Rebuilds the generated part of the multiplier table of ../src/lcg.hpp
+# from the output of gensel.py, using the second choice for each type and
+# size (as in the tables of the paper).
+
+import re
+import sys
+
+if len(sys.argv) != 3:
+    sys.stderr.write("Usage: %s best_harmonic.txt lcg.hpp\n" % sys.argv[0])
+    exit(1)
+
+choices = {}
+for line in open(sys.argv[1]):
+    line = line.strip()
+    if not line:
+        continue
+    file, h = line.split('\t')
+    # The second occurrence of a file is the second choice
+    choices[file] = h
+
+table = []
+for file, h in choices.items():
+    kind, state, bits = re.match(r"(LCG|MCG)-(\d+)-(\d+)-L$", file).groups()
+    m = int(h, 16)
+    table.append("\t{ %s, %s, %s, 0x%x, 0x%x }, // %s-%s-%s\n" % ("true" if kind == "MCG" else "false", state, bits, m >> 64, m & (2**64 - 1), kind, state, bits))
+
+source = open(sys.argv[2]).read()
+begin = source.index("// BEGIN GENERATED TABLE\n") + len("// BEGIN GENERATED TABLE\n")
+end = source.index("// END GENERATED TABLE\n")
+open(sys.argv[2], "w").write(source[:begin] + "".join(table) + source[end:])
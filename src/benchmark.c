@@ -6,229 +6,229 @@ worldwide. This software is distributed without any warranty.
 
 See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
-/* 
+/*
 
 Microbenchmarks for multipliers of different sizes. Please compile with
 
-gcc -fno-unroll-loops -fomit-frame-pointer -O3 -DCONST=0 test.c -o test-mcg
-gcc -fno-unroll-loops -fomit-frame-pointer -O3 -DCONST=0xdeadbeefdeadf00d test.c -o test-lcg
+gcc -fno-unroll-loops -fomit-frame-pointer -O3 benchmark.c -o benchmark
 
-(or your favorite compiler) and run with
+(or your favorite compiler, possibly adding -march=native) and run with
 
-./test-mcg 1000000000
-./test-lcg 1000000000
+./benchmark 1000000000
+
+For each multiplier size, and both for LCGs and MCGs, a state of 128 bits is
+advanced in two modes: latency, in which each step depends on the previous
+one, as in a single generator, and throughput, in which STREAMS independent
+states are advanced in an interleaved fashion, so the processor can overlap
+their multiplications. Each measurement is repeated after warmup runs, and
+the median and the median absolute deviation (MAD) of the time per word are
+reported, together with the median number of time-stamp-counter cycles per
+word on x86 (note that the time-stamp counter runs at a constant reference
+frequency, which may differ from the actual core frequency).
+
+All kernels are generated from the same macro, so adding a multiplier size
+requires adding a line to MULTIPLIERS.
 
 */
 
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/time.h>
-#include <sys/resource.h>
-
-uint64_t get_user_time(void) {
-	struct rusage rusage;
-	getrusage(0, &rusage);
-	return rusage.ru_utime.tv_sec * 1000000000ULL + rusage.ru_utime.tv_usec * 1000ULL;
-}
-
-__uint128_t __attribute__((noinline)) f64(__uint128_t a) {
-	return a * 0xdeadf00ddeadf00d + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f65(__uint128_t a) {
-	return a * (((__uint128_t)1 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f66_2(__uint128_t a) {
-	return a * (((__uint128_t)2 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f66_3(__uint128_t a) {
-	return a * (((__uint128_t)3 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f67_4(__uint128_t a) {
-	return a * (((__uint128_t)4 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f67_5(__uint128_t a) {
-	return a * (((__uint128_t)5 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f67_6(__uint128_t a) {
-	return a * (((__uint128_t)6 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f67_7(__uint128_t a) {
-	return a * (((__uint128_t)7 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f68_0xc(__uint128_t a) {
-	return a * (((__uint128_t)0xc << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f69_0x18(__uint128_t a) {
-	return a * (((__uint128_t)0x18 << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f72(__uint128_t a) {
-	return a * (((__uint128_t)0xEF << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
-
-__uint128_t __attribute__((noinline)) f80(__uint128_t a) {
-	return a * (((__uint128_t)0xBEEF << 64) + 0xdeadf00ddeadf00d) + CONST;
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+// Number of independent states in throughput mode
+#ifndef STREAMS
+#define STREAMS 8
+#endif
+
+#define LOWER 0xdeadf00ddeadf00d
+#define INCREMENT 0xdeadbeefdeadf00d
+
+// Name and upper 64 bits of each multiplier; the lower 64 bits are LOWER.
+#define MULTIPLIERS \
+	X(64, 0) \
+	X(65, 1) \
+	X(66_2, 2) \
+	X(66_3, 3) \
+	X(67_4, 4) \
+	X(67_5, 5) \
+	X(67_6, 6) \
+	X(67_7, 7) \
+	X(68_0xc, 0xc) \
+	X(69_0x18, 0x18) \
+	X(72, 0xEF) \
+	X(80, 0xBEEF) \
+	X(81, 0x1BEEF) \
+	X(95, 0x7EADBEEF) \
+	X(96, 0xDEADBEEF) \
+	X(128, 0xDEADBEEFDEADBEEF)
+
+typedef __uint128_t (*kernel_t)(__uint128_t *, uint64_t);
+
+/* The kernel: advances the state(s) in x by n steps in total, using a
+   constant multiplier and increment, so the compiler can specialize the
+   multiplication as it would in a generator. Returns a value depending on
+   all states, so the computation cannot be optimized away. */
+#define KERNEL(name, hi, type, c) \
+static __uint128_t __attribute__((noinline)) latency_##type##_##name(__uint128_t *x, uint64_t n) { \
+	__uint128_t s = *x; \
+	while (n-- != 0) s = s * (((__uint128_t)(hi) << 64) + LOWER) + (c); \
+	return *x = s; \
+} \
+static __uint128_t __attribute__((noinline)) throughput_##type##_##name(__uint128_t *x, uint64_t n) { \
+	__uint128_t s[STREAMS], r = 0; \
+	memcpy(s, x, sizeof s); \
+	for (n /= STREAMS; n-- != 0;) \
+		for (int j = 0; j < STREAMS; j++) s[j] = s[j] * (((__uint128_t)(hi) << 64) + LOWER) + (c); \
+	memcpy(x, s, sizeof s); \
+	for (int j = 0; j < STREAMS; j++) r ^= s[j]; \
+	return r; \
+}
+
+#define X(name, hi) KERNEL(name, hi, lcg, INCREMENT) KERNEL(name, hi, mcg, 0)
+MULTIPLIERS
+#undef X
+
+static const struct {
+	const char *name;
+	kernel_t kernel[2][2]; // Indexed by MCG and throughput mode
+} kernels[] = {
+#define X(name, hi) { #name, { { latency_lcg_##name, throughput_lcg_##name }, { latency_mcg_##name, throughput_mcg_##name } } },
+	MULTIPLIERS
+#undef X
+};
+
+static uint64_t get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t get_cycles(void) {
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
 }
 
-__uint128_t __attribute__((noinline)) f81(__uint128_t a) {
-	return a * (((__uint128_t)0x1BEEF << 64) + 0xdeadf00ddeadf00d) + CONST;
+static int cmp_double(const void *a, const void *b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
 }
 
-__uint128_t __attribute__((noinline)) f95(__uint128_t a) {
-	return a * (((__uint128_t)0x7EADBEEF << 64) + 0xdeadf00ddeadf00d) + CONST;
+// Sorts the array and returns its median.
+static double median(double * const v, const int n) {
+	qsort(v, n, sizeof *v, cmp_double);
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
 }
 
-__uint128_t __attribute__((noinline)) f96(__uint128_t a) {
-	return a * (((__uint128_t)0xDEADBEEF << 64) + 0xdeadf00ddeadf00d) + CONST;
+// Median absolute deviation from the median m.
+static double mad(const double * const v, const int n, const double m) {
+	double d[n];
+	for (int i = 0; i < n; i++) d[i] = fabs(v[i] - m);
+	return median(d, n);
 }
 
-__uint128_t __attribute__((noinline)) f128(__uint128_t a) {
-	return a * (((__uint128_t)0xDEADBEEFDEADBEEF << 64) + 0xdeadf00ddeadf00d) + CONST;
-}
+enum format { TEXT, CSV, JSON };
 
+volatile __uint128_t sink;
 
 int main(int argc, char *argv[]) {
-	if (argc != 2) {
-		fprintf(stderr, "USAGE: %s ITERATIONS\n", argv[0]);
-		exit(1);
+	int repeats = 11, warmup = 1, types = 3, opt;
+	enum format format = TEXT;
+
+	while ((opt = getopt(argc, argv, "r:w:t:f:")) != -1) {
+		switch (opt) {
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 't':
+			types = strcmp(optarg, "lcg") == 0 ? 1 : strcmp(optarg, "mcg") == 0 ? 2 : strcmp(optarg, "both") == 0 ? 3 : 0;
+			break;
+		case 'f':
+			format = strcmp(optarg, "text") == 0 ? TEXT : strcmp(optarg, "csv") == 0 ? CSV : strcmp(optarg, "json") == 0 ? JSON : -1;
+			break;
+		default:
+			exit(1);
+		}
 	}
-	const uint64_t n = strtoll(argv[1], NULL, 0);
-
-	__uint128_t x = n;
-
-	uint64_t start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f64(x);
-
-	uint64_t time_delta = (get_user_time() - start_time);
-	printf("64: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f65(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("65: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f66_2(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("66_2: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f66_3(x);
 
-	time_delta = (get_user_time() - start_time);
-	printf("66_3: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f67_4(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("67_4: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f67_5(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("67_5: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f67_6(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("67_6: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f67_7(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("67_7: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f68_0xc(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("68_0xc: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f69_0x18(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("69_0x18: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f72(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("72: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f80(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("80: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f81(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("81: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f95(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("95: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f96(x);
-
-	time_delta = (get_user_time() - start_time);
-	printf("96: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
-
-
-	start_time = get_user_time();
-	for(int64_t i = n; i-- != 0;)
-		x = f128(x);
+	if (argc - optind != 1 || repeats < 1 || warmup < 0 || types == 0 || (int)format == -1) {
+		fprintf(stderr, "USAGE: %s [-r REPEATS] [-w WARMUP] [-t lcg|mcg|both] [-f text|csv|json] ITERATIONS\n\n", argv[0]);
+		fprintf(stderr, "Measures the time per step of 128-bit LCGs and MCGs with multipliers of\n");
+		fprintf(stderr, "different sizes in latency mode (a dependent chain) and throughput mode\n");
+		fprintf(stderr, "(%d independent states), performing ITERATIONS steps per run. Each\n", STREAMS);
+		fprintf(stderr, "measurement is repeated REPEATS times (default: 11) after WARMUP runs\n");
+		fprintf(stderr, "(default: 1), and the median and MAD are reported. Output is a table\n");
+		fprintf(stderr, "(default), CSV or JSON.\n");
+		exit(1);
+	}
 
-	time_delta = (get_user_time() - start_time);
-	printf("128: %s: %.03f s, %.03f GB/s, %.03f words/ns, %.03f ns/word\n", argv[0], time_delta / 1E9, (n * 8.) / time_delta, n / (double)time_delta, time_delta / (double)n);
+	const uint64_t n = strtoull(argv[optind], NULL, 0);
+	const int nkernels = sizeof kernels / sizeof *kernels;
+	const char * const mode_name[] = { "latency", "throughput" };
+	double ns[repeats], cycles[repeats];
+	int first = 1;
+
+	if (format == CSV) printf("type,multiplier,mode,iterations,repeats,ns_per_word,ns_per_word_mad,cycles_per_word,words_per_ns,gb_per_s\n");
+	if (format == JSON) printf("{\n\"compiler\": \"%s\",\n\"iterations\": %llu,\n\"repeats\": %d,\n\"streams\": %d,\n\"results\": [\n", __VERSION__, (unsigned long long)n, repeats, STREAMS);
+
+	for (int mcg = 0; mcg < 2; mcg++) {
+		if (! (types & (1 << mcg))) continue;
+		for (int k = 0; k < nkernels; k++)
+			for (int mode = 0; mode < 2; mode++) {
+				const kernel_t kernel = kernels[k].kernel[mcg][mode];
+				__uint128_t x[STREAMS];
+				// MCGs need odd states
+				for (int j = 0; j < STREAMS; j++) x[j] = 2 * (n + j) + 1;
+
+				for (int r = 0; r < warmup; r++) sink = kernel(x, n);
+				for (int r = 0; r < repeats; r++) {
+					const uint64_t start_cycles = get_cycles(), start_time = get_time();
+					sink = kernel(x, n);
+					const uint64_t time_delta = get_time() - start_time, cycles_delta = get_cycles() - start_cycles;
+					ns[r] = time_delta / (double)n;
+					cycles[r] = cycles_delta / (double)n;
+				}
+
+				const double m = median(ns, repeats), d = mad(ns, repeats, m);
+#ifdef HAVE_TSC
+				const double c = median(cycles, repeats);
+#else
+				const double c = NAN;
+#endif
+				const char * const type = mcg ? "MCG" : "LCG";
+
+				switch (format) {
+				case TEXT:
+					printf("%s %s %s: %.03f ns/word (MAD %.03f), %.03f cycles/word, %.03f words/ns, %.03f GB/s\n", type, kernels[k].name, mode_name[mode], m, d, c, 1 / m, 8 / m);
+					break;
+				case CSV:
+					printf("%s,%s,%s,%llu,%d,%.06f,%.06f,%.06f,%.06f,%.06f\n", type, kernels[k].name, mode_name[mode], (unsigned long long)n, repeats, m, d, c, 1 / m, 8 / m);
+					break;
+				case JSON:
+					printf("%s{ \"type\": \"%s\", \"multiplier\": \"%s\", \"mode\": \"%s\", \"ns_per_word\": %.06f, \"ns_per_word_mad\": %.06f, ", first ? "" : ",\n", type, kernels[k].name, mode_name[mode], m, d);
+					if (isnan(c)) printf("\"cycles_per_word\": null, ");
+					else printf("\"cycles_per_word\": %.06f, ", c);
+					printf("\"words_per_ns\": %.06f, \"gb_per_s\": %.06f }", 1 / m, 8 / m);
+					break;
+				}
+				first = 0;
+				fflush(stdout);
+			}
+	}
 
-	const volatile __uint128_t unused = x;
+	if (format == JSON) printf("\n]\n}\n");
 	return 0;
 }
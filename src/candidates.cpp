@@ -0,0 +1,195 @@
+/*  Written in 2019-2021 by Guy Steele and Sebastiano Vigna
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Candidate generation strategies for search.
+
+   All strategies generate only multipliers of the given size whose residue
+   modulo 8 is 5 (see search.cpp). Candidates are numbered globally, and
+   search evaluates them in blocks: a candidate_generator is owned by a single
+   thread, start() must be called at the beginning of each block, and next()
+   returns the candidate with a given index using the pseudorandom generator
+   of the block, so the candidates of a block depend only on the block.
+   feedback() must be called after evaluating each candidate.
+
+   - uniform: random multipliers (the default);
+   - exhaustive: multipliers SEED * 8 + 5, SEED * 8 + 13, ... in order;
+   - stratified: a digitally shifted van der Corput sequence on the
+     multipliers, so that the first 2^k candidates fall each in a different
+     of 2^k intervals of equal size; beyond 64 bits, lower bits are random;
+   - hill: local search starting from random multipliers: once a candidate
+     passes the threshold, the following candidates are obtained by flipping
+     a few random bits of the current multiplier, which is replaced whenever a
+     candidate passing the threshold has a better harmonic score; if there
+     is no improvement for a while, the search restarts from random
+     multipliers;
+   - anneal: like hill, but a candidate passing the threshold with a worse
+     harmonic score is accepted with probability exp(delta / T) (simulated
+     annealing), where the temperature T decreases geometrically.
+
+   Local searches restart at every block, and a multiplier is never proposed
+   twice in the same block.
+
+   Must be included after common.cpp. */
+
+#include <cmath>
+#include <cstring>
+#include <set>
+
+enum candidate_strategy { UNIFORM, EXHAUSTIVE, STRATIFIED, HILL, ANNEAL };
+
+static const char * const strategy_names[] = { "uniform", "exhaustive", "stratified", "hill", "anneal" };
+
+// Returns the strategy with the given name, or -1.
+inline int strategy_by_name(const char * const name) {
+	for (int i = 0; i < (int)(sizeof strategy_names / sizeof *strategy_names); i++)
+		if (strcmp(name, strategy_names[i]) == 0) return i;
+	return -1;
+}
+
+struct candidate_generator {
+	// Number of candidates without improvement after which a local search restarts
+	static constexpr int64_t patience = 1024;
+	// Initial temperature of annealing, and cooling factor per candidate passing the threshold
+	static constexpr double initial_temperature = 0.01, cooling = 0.999;
+	// Maximum number of attempts at generating a new neighbor
+	static constexpr int max_attempts = 16;
+
+	const candidate_strategy strategy;
+	const uint64_t seed;
+	const int multiplier_size;
+	const ZZ multiplier_mask, multiplier_surround_bits;
+	uint64_t shift; // The digital shift of the stratified strategy
+	ZZ a, x; // The last candidate, and scratch space
+
+	// State of local searches
+	bool climbing; // Whether cur is a multiplier passing the threshold
+	ZZ cur;
+	double cur_harm, temperature;
+	int64_t stale; // Candidates evaluated since the last improvement
+	std::set<ZZ> seen; // Candidates of the current block
+
+	candidate_generator(candidate_strategy strategy, uint64_t seed, int multiplier_size) :
+		strategy(strategy), seed(seed), multiplier_size(multiplier_size),
+		multiplier_mask((conv<ZZ>(1) << (multiplier_size - 1)) - 8),
+		multiplier_surround_bits(conv<ZZ>(1) << (multiplier_size - 1) | 5) {
+		xoshiro256 r;
+		r.init(seed << 8 | multiplier_size | 0x80);
+		shift = r.next();
+		start();
+	}
+
+	// Number of bits of a candidate that are not fixed.
+	int free_bits() const { return max(0, multiplier_size - 4); }
+
+	// Must be called at the start of each block.
+	void start() {
+		climbing = false;
+		seen.clear();
+	}
+
+	// Stores in a random bits using r.
+	static void random_bits(ZZ &a, xoshiro256 &r) {
+#if defined(__clang__) && defined(__APPLE__)
+		// https://github.com/libntl/ntl/issues/28
+		a = (((conv<ZZ>(0) + (unsigned long)r.next()) << 192) + ((conv<ZZ>(0) + (unsigned long)r.next()) << 128) + ((conv<ZZ>(0) + (unsigned long)r.next()) << 64) + conv<ZZ>((unsigned long)r.next()));
+#else
+		a = (((conv<ZZ>(0) + r.next()) << 192) + ((conv<ZZ>(0) + r.next()) << 128) + ((conv<ZZ>(0) + r.next()) << 64) + conv<ZZ>(r.next()));
+#endif
+	}
+
+	// Returns candidate c, using r for randomness.
+	const ZZ &next(const int64_t c, xoshiro256 &r) {
+		switch(strategy) {
+		case UNIFORM:
+			uniform(r);
+			break;
+		case EXHAUSTIVE:
+			a = ((((conv<ZZ>(0) + c) + seed) * 8) & multiplier_mask) | multiplier_surround_bits;
+			break;
+		case STRATIFIED:
+			stratified(c, r);
+			break;
+		case HILL:
+		case ANNEAL:
+			if (! climbing || ! neighbor(r)) uniform(r);
+			seen.insert(a);
+			break;
+		}
+		return a;
+	}
+
+	// Random odd multiplier in the range [2^(multiplier_size-1)..2^multiplier_size) whose residual modulo 8 is 5; it fits in multiplier_size bits
+	void uniform(xoshiro256 &r) {
+		random_bits(a, r);
+		a = (a & multiplier_mask) | multiplier_surround_bits;
+	}
+
+	void stratified(const int64_t c, xoshiro256 &r) {
+		// Bit reversal of c
+		uint64_t v = c;
+		v = (v >> 1 & 0x5555555555555555) | (v & 0x5555555555555555) << 1;
+		v = (v >> 2 & 0x3333333333333333) | (v & 0x3333333333333333) << 2;
+		v = (v >> 4 & 0x0F0F0F0F0F0F0F0F) | (v & 0x0F0F0F0F0F0F0F0F) << 4;
+		v = __builtin_bswap64(v) ^ shift;
+
+		const int n = free_bits();
+		if (n <= 64) a = conv<ZZ>(n == 0 ? 0 : v >> (64 - n));
+		else {
+			random_bits(x, r);
+			a = (conv<ZZ>(v) << (n - 64)) | (x & ((conv<ZZ>(1) << (n - 64)) - 1));
+		}
+		a = ((a << 3) & multiplier_mask) | multiplier_surround_bits;
+	}
+
+	/* Stores in a a multiplier not seen in the current block obtained by
+	   flipping a geometrically distributed number of random free bits of cur;
+	   returns false if no such multiplier was found. */
+	bool neighbor(xoshiro256 &r) {
+		const int n = free_bits();
+		if (n == 0) return false;
+		for (int i = 0; i < max_attempts; i++) {
+			a = cur;
+			const uint64_t flips = r.next();
+			for (int f = 0; f == 0 || (f < 8 && (flips >> (f - 1) & 1)); f++) SwitchBit(a, 3 + r.next() % n);
+			if (a != cur && seen.count(a) == 0) return true;
+		}
+		return false;
+	}
+
+	/* Must be called after the evaluation of each candidate, passing whether
+	   it passed the threshold and, if so, its harmonic score. */
+	void feedback(const bool accepted, const double harm_score, xoshiro256 &r) {
+		if (strategy != HILL && strategy != ANNEAL) return;
+
+		if (! accepted) {
+			if (climbing && ++stale >= patience) climbing = false;
+			return;
+		}
+
+		if (! climbing) {
+			climbing = true;
+			cur = a;
+			cur_harm = harm_score;
+			temperature = initial_temperature;
+			stale = 0;
+			return;
+		}
+
+		if (harm_score > cur_harm) stale = 0;
+		else if (++stale >= patience) {
+			climbing = false;
+			return;
+		}
+
+		if (harm_score > cur_harm || (strategy == ANNEAL && (r.next() >> 11) * 0x1.0p-53 < exp((harm_score - cur_harm) / temperature))) {
+			cur = a;
+			cur_harm = harm_score;
+		}
+		temperature *= cooling;
+	}
+};
@@ -6,11 +6,11 @@ worldwide. This software is distributed without any warranty.
 
 See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
-/* Prints the figures of merit for a multiplier and a power-of-two
-   modulus. If MULT is defined, computes figures of merit for an MCG;
-   otherwise, for an LCG. */
+/* Code shared by all programs: constants, the pseudorandom generator and
+   conversions. */
 
 #include <algorithm>
+#include <cstring>
 
 const int dim_max = 24;
 
@@ -18,7 +18,7 @@ typedef __uint128_t uint128_t;
 
 /* These are the values of gamma_t in Knuth, taken from L'Ecuyer's Lattice Tester. */
 
-static double norm[] = {
+static const double gamma_t[] = {
 	1.1547005383793, // gamma_2
 	1.2599210498949,
 	1.4142135623731,
@@ -48,38 +48,71 @@ static inline uint64_t rotl(const uint64_t x, int k) {
 	return (x << k) | (x >> (64 - k));
 }
 
-// xoshiro256**
-static uint64_t s[4];
-
-// Initialization by SplitMix64
-static void init(uint64_t x) {
-	for(int i = 0; i < 4; i++) {
-		uint64_t z = (x += 0x9e3779b97f4a7c15);
-		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
-		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
-		s[i] = z ^ (z >> 31);
+/* xoshiro256**. Each thread owns an instance; disjoint streams are obtained
+   by jumping a copy of the initial state. */
+struct xoshiro256 {
+	uint64_t s[4];
+
+	// Initialization by SplitMix64
+	void init(uint64_t x) {
+		for(int i = 0; i < 4; i++) {
+			uint64_t z = (x += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			s[i] = z ^ (z >> 31);
+		}
 	}
-}
 
-static uint64_t next(void) {
-	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t next(void) {
+		const uint64_t result = rotl(s[1] * 5, 7) * 9;
+
+		const uint64_t t = s[1] << 17;
+
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
 
-	const uint64_t t = s[1] << 17;
+		s[2] ^= t;
 
-	s[2] ^= s[0];
-	s[3] ^= s[1];
-	s[1] ^= s[2];
-	s[0] ^= s[3];
+		s[3] = rotl(s[3], 45);
 
-	s[2] ^= t;
+		return result;
+	}
+
+	/* Equivalent to 2^128 calls to next(); it can be used to generate 2^128
+	   non-overlapping subsequences for parallel computations. */
+	void jump(void) {
+		static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+
+		uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		for(int i = 0; i < 4; i++)
+			for(int b = 0; b < 64; b++) {
+				if (JUMP[i] & UINT64_C(1) << b) {
+					s0 ^= s[0];
+					s1 ^= s[1];
+					s2 ^= s[2];
+					s3 ^= s[3];
+				}
+				next();
+			}
 
-	s[3] = rotl(s[3], 45);
+		s[0] = s0;
+		s[1] = s1;
+		s[2] = s2;
+		s[3] = s3;
+	}
+};
 
-	return result;
+/* Whether the program was invoked through a name starting with "m" (e.g.,
+   msearch), which selects MCGs with power-of-two moduli, as -m does. */
+inline bool mcg_by_name(const char * const argv0) {
+	const char * const slash = strrchr(argv0, '/');
+	return (slash == NULL ? argv0 : slash + 1)[0] == 'm';
 }
 
 // Conversion for large integers in hexadecimal form, too. Supports the "2^k" format.
-static ZZ strtoZZ(const char * const s) {
+inline ZZ strtoZZ(const char * const s) {
 	if (strstr(s, "2^") == s) {
 		// Special case: power of 2
 		long long p = strtoull(s + 2, NULL, 0);
@@ -121,8 +154,13 @@ template <> ZZ NTL_NAMESPACE::conv<>(const uint128_t& x) {
 	return conv<ZZ, unsigned long>(uint64_t(x >> 64)) << 64 | conv<ZZ, unsigned long>((uint64_t&)x);
 }
 
+// The lower 128 bits of the absolute value (as for NTL bitwise operations), without allocating memory
 template <> uint128_t NTL_NAMESPACE::conv<>(const ZZ& x) {
-	return uint128_t(conv<unsigned long>(x >> 64 & conv<ZZ>(0xFFFFFFFFFFFFFFFF))) << 64 | conv<unsigned long>(x & conv<ZZ>(0xFFFFFFFFFFFFFFFF));
+	unsigned char b[16];
+	BytesFromZZ(b, x, sizeof b);
+	uint128_t r = 0;
+	for (int i = sizeof b; i-- != 0;) r = r << 8 | b[i];
+	return r;
 }
 
 #else
@@ -131,8 +169,13 @@ template <> ZZ NTL::conv<>(const uint128_t& x) {
 	return conv<ZZ>(uint64_t(x >> 64)) << 64 | conv<ZZ>((uint64_t&)x);
 }
 
+// The lower 128 bits of the absolute value (as for NTL bitwise operations), without allocating memory
 template <> uint128_t NTL::conv<>(const ZZ& x) {
-	return uint128_t(conv<uint64_t>(x >> 64 & conv<ZZ>(0xFFFFFFFFFFFFFFFF))) << 64 | conv<uint64_t>(x & conv<ZZ>(0xFFFFFFFFFFFFFFFF));
+	unsigned char b[16];
+	BytesFromZZ(b, x, sizeof b);
+	uint128_t r = 0;
+	for (int i = sizeof b; i-- != 0;) r = r << 8 | b[i];
+	return r;
 }
 
 #endif
@@ -1,8 +1,17 @@
 #!/bin/bash
 
-g++ -std=c++17 -O3 -march=native search.cpp -o search -lntl
-g++ -std=c++17 -O3 -march=native search.cpp -DMULT -o msearch -lntl
-g++ -std=c++17 -O3 -march=native spect.cpp -o spect -lntl
-g++ -std=c++17 -O3 -march=native spect.cpp -DMULT -o mspect -lntl
+g++ -std=c++17 -O3 -march=native -pthread search.cpp -o search -lntl
+ln -f search msearch
+g++ -std=c++17 -O3 -march=native -pthread sweep.cpp -o sweep -lntl
+g++ -std=c++17 -O3 -march=native -pthread spect.cpp -o spect -lntl
+ln -f spect mspect
 g++ -std=c++17 -O3 -march=native printdat.cpp -o printdat -lntl
-g++ -std=c++17 -O3 -march=native printdat.cpp -DMULT -o mprintdat -lntl
+ln -f printdat mprintdat
+g++ -std=c++17 -O3 -march=native leapfrog.cpp -o leapfrog -lntl
+g++ -std=c++17 -O3 -march=native specbench.cpp -o specbench -lntl
+g++ -std=c++17 -O3 -march=native dbconv.cpp -o dbconv
+g++ -std=c++17 -O3 -march=native -pthread filter.cpp -o filter
+g++ -std=c++17 -O3 -march=native -pthread gensel.cpp -o gensel
+g++ -std=c++17 -O3 -march=native mkdb.cpp -o mkdb
+g++ -std=c++17 -O3 -march=native lookup.cpp -o lookup
+g++ -std=c++17 -O3 -march=native multibench.cpp -o multibench
@@ -0,0 +1,155 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Converts candidate databases between the text format generated by search
+   (or the aggregate format generated by ../python/filter.sh) and the binary
+   columnar format described in dbformat.cpp. */
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+#include "dbformat.cpp"
+
+int main(int argc, char *argv[]) {
+	bool to_text = false, lagged = false;
+	int score_bytes = 4, lag = 1, opt;
+
+	while ((opt = getopt(argc, argv, "+x8al:")) != -1) {
+		switch (opt) {
+		case 'x':
+			to_text = true;
+			break;
+		case '8':
+			score_bytes = 8;
+			break;
+		case 'a':
+			lagged = true;
+			break;
+		case 'l':
+			lag = atoi(optarg);
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != (to_text ? 2 : 4)) {
+		cerr << "USAGE: " << argv[0] << " [-8] [-a] [-l LAG] LCG|MCG STATE MSIZE < TEXT > BINARY" << endl;
+		cerr << "       " << argv[0] << " -x BINARY > TEXT" << endl << endl;
+		cerr << "Converts a database in the text format generated by search into" << endl;
+		cerr << "a binary columnar database, or, with -x, a binary database into" << endl;
+		cerr << "text. STATE is the number of bits of state (e.g., 64 for modulus" << endl;
+		cerr << "2^64), MSIZE the multiplier size in bits (at most 128). Scores are" << endl;
+		cerr << "stored as floats, or as doubles with -8. With -a, the input has" << endl;
+		cerr << "the aggregate format generated by ../python/filter.sh (or by" << endl;
+		cerr << "search -l), which contains a minimum lagged score. With -l, the" << endl;
+		cerr << "figures of merit are for the given lag (default: 1)." << endl;
+		exit(1);
+	}
+
+	if (to_text) {
+		const db_reader db(argv[1]);
+		const int c = db.h.score_columns();
+		vector<double> scores(c);
+		for (int64_t i = 0; i < db.rows(); i++) {
+			for (int j = 0; j < c; j++) scores[j] = db.score(j, i);
+			db_print_row(stdout, db.h, db.multiplier(i), scores.data());
+		}
+		return 0;
+	}
+
+	db_header h;
+	if (strcmp(argv[1], "MCG") == 0) h.mcg = 1;
+	else if (strcmp(argv[1], "LCG") != 0) {
+		cerr << "The generator type must be LCG or MCG: " << argv[1] << endl;
+		exit(1);
+	}
+	h.state = atoi(argv[2]);
+	h.msize = atoi(argv[3]);
+	if (h.msize < 1 || h.msize > 128) {
+		cerr << "Invalid multiplier size: " << argv[3] << endl;
+		exit(1);
+	}
+	h.lagged = lagged;
+	h.lag = lag;
+	h.mult_bytes = h.msize <= 64 ? 8 : 16;
+	h.score_bytes = score_bytes;
+
+	char *line = NULL;
+	size_t size = 0;
+	int64_t line_number = 0;
+	vector<char *> field;
+	vector<double> scores;
+	string rows;
+	db_writer *w = NULL;
+
+	while (getline(&line, &size, stdin) != -1) {
+		line_number++;
+		field.clear();
+		for (char *p = strtok(line, "\t \n"); p != NULL; p = strtok(NULL, "\t \n")) field.push_back(p);
+		if (field.empty()) continue;
+
+		// Score columns before the multiplier, and total number of columns
+		const int k = 2 + lagged, columns = field.size();
+		if (w == NULL) {
+			h.max_dim = columns - k - 1;
+			if (h.max_dim < 2 || ! h.valid()) {
+				cerr << "Unrecognized format at line " << line_number << endl;
+				exit(1);
+			}
+			w = new db_writer(stdout, h);
+		}
+		else if (columns != h.score_columns() + 2) {
+			cerr << "Wrong number of columns at line " << line_number << endl;
+			exit(1);
+		}
+
+		uint128_t a = 0;
+		for (const char *p = field[k]; *p; p++) {
+			if (! isdigit(*p) || a > (~(uint128_t)0 - 9) / 10) {
+				cerr << "Invalid multiplier at line " << line_number << ": " << field[k] << endl;
+				exit(1);
+			}
+			a = a * 10 + (*p - '0');
+		}
+		if (h.mult_bytes == 8 && a >> 64 != 0) {
+			cerr << "Multiplier too large for MSIZE at line " << line_number << ": " << field[k] << endl;
+			exit(1);
+		}
+
+		scores.clear();
+		for (int i = 0; i < columns; i++) {
+			if (i == k || i == k + 1) continue; // Decimal and hexadecimal multiplier
+			char *end;
+			scores.push_back(strtod(field[i], &end));
+			if (*end) {
+				cerr << "Invalid score at line " << line_number << ": " << field[i] << endl;
+				exit(1);
+			}
+		}
+
+		rows.clear();
+		db_row(rows, a, scores.data(), scores.size());
+		w->add(rows);
+	}
+
+	if (w == NULL) {
+		cerr << "Empty input" << endl;
+		exit(1);
+	}
+
+	w->flush();
+	delete w;
+	free(line);
+	return 0;
+}
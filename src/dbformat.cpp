@@ -0,0 +1,235 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Binary columnar format for candidate databases, written by search and spect
+   with --binary and converted to and from text by dbconv. It does not depend
+   on NTL.
+
+   A file starts with a db_header, followed by row groups. A group starts
+   with its number of rows n (a uint64_t), followed by n multipliers (8 or 16
+   bytes each, depending on the multiplier size) and then by n scores for
+   each score column (floats or doubles). Score columns are, in order, the
+   minimum spectral score, the minimum lagged score (only for lagged
+   databases), the harmonic spectral score and the figures of merit in
+   dimension 2 to max_dim. All values are little endian. Floats are rounded
+   to six decimal places, like scores in the text format.
+
+   Since groups carry their size, files can be concatenated after stripping
+   the header of all but the first one, and writers can flush a group at
+   any time (search does so when saving a checkpoint). */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef __uint128_t uint128_t;
+
+struct db_header {
+	char magic[8]; // "SPECTDB1"
+	uint8_t mcg; // 1 for MCGs with power-of-two moduli, 0 otherwise
+	uint8_t lagged; // 1 if the minimum lagged score column is present
+	uint8_t mult_bytes; // 8 or 16
+	uint8_t score_bytes; // 4 (float) or 8 (double)
+	uint32_t state; // Bits of state (e.g., 64 for modulus 2^64)
+	uint32_t msize; // Multiplier size in bits, or 0 if unknown
+	uint32_t max_dim;
+	uint32_t lag; // The lag of the figures of merit (1 for the standard spectral test)
+	uint32_t reserved;
+
+	db_header() { memset(this, 0, sizeof *this); memcpy(magic, "SPECTDB1", 8); lag = 1; }
+
+	int score_columns() const { return 2 + lagged + max_dim - 1; }
+
+	size_t row_bytes() const { return mult_bytes + score_columns() * score_bytes; }
+
+	bool valid() const {
+		return memcmp(magic, "SPECTDB1", 8) == 0 && mcg <= 1 && lagged <= 1 && (mult_bytes == 8 || mult_bytes == 16) && (score_bytes == 4 || score_bytes == 8) && max_dim >= 2 && max_dim <= 64;
+	}
+};
+
+static_assert(sizeof(db_header) == 32, "db_header must be packed");
+
+// Appends to buf a row, as passed to db_writer::add(): a multiplier followed by n scores.
+inline void db_row(std::string &buf, const uint128_t a, const double * const scores, const int n) {
+	buf.append((const char *)&a, sizeof a);
+	buf.append((const char *)scores, n * sizeof *scores);
+}
+
+// Prints a row in the text format of search (or of the aggregate files, for lagged databases).
+inline void db_print_row(FILE * const f, const db_header &h, const uint128_t a, const double * const scores) {
+	char dec[48], hex[48], *d = dec + sizeof dec, *x = hex + sizeof hex;
+	*--d = *--x = 0;
+	uint128_t t = a;
+	do *--d = '0' + t % 10; while ((t /= 10) != 0);
+	t = a;
+	do *--x = "0123456789abcdef"[t % 16]; while ((t /= 16) != 0);
+
+	const int k = 2 + h.lagged; // Number of scores before the multiplier
+	for (int i = 0; i < k; i++) fprintf(f, "%8.6f\t", scores[i]);
+	fprintf(f, "%s\t0x%s", d, x);
+	for (int i = k; i < h.score_columns(); i++) fprintf(f, "\t%8.6f", scores[i]);
+	fputc('\n', f);
+}
+
+struct db_writer {
+	FILE *f;
+	db_header h;
+	size_t group_rows;
+	std::vector<uint128_t> mult;
+	std::vector<double> scores; // Row-major, h.score_columns() per row
+
+	// If write_header is false, rows are appended to an existing file.
+	db_writer(FILE * const f, const db_header &h, const bool write_header = true, const size_t group_rows = 1 << 16) : f(f), h(h), group_rows(group_rows) {
+		if (write_header) write(&h, sizeof h);
+	}
+
+	void write(const void * const p, const size_t n) {
+		if (fwrite(p, 1, n, f) != n) {
+			perror("fwrite");
+			exit(1);
+		}
+	}
+
+	// Adds rows generated by db_row().
+	void add(const std::string &rows) {
+		const int c = h.score_columns();
+		const size_t size = sizeof(uint128_t) + c * sizeof(double);
+		for (const char *p = rows.data(); p < rows.data() + rows.size(); p += size) {
+			uint128_t a;
+			memcpy(&a, p, sizeof a);
+			mult.push_back(a);
+			const size_t s = scores.size();
+			scores.resize(s + c);
+			memcpy(&scores[s], p + sizeof a, c * sizeof(double));
+			if (mult.size() == group_rows) flush();
+		}
+	}
+
+	// Writes the pending rows, if any, as a group (but does not flush the underlying file).
+	void flush() {
+		const uint64_t n = mult.size();
+		if (n == 0) return;
+		write(&n, sizeof n);
+		if (h.mult_bytes == 16) write(mult.data(), n * sizeof(uint128_t));
+		else for (uint128_t a : mult) {
+			const uint64_t x = a;
+			write(&x, sizeof x);
+		}
+
+		const int c = h.score_columns();
+		std::vector<float> fcol(n);
+		std::vector<double> dcol(n);
+		for (int j = 0; j < c; j++) {
+			if (h.score_bytes == 4) {
+				// Rounding to six decimal places first makes floats print as the text format
+				for (size_t i = 0; i < n; i++) fcol[i] = nearbyint(scores[i * c + j] * 1E6) / 1E6;
+				write(fcol.data(), n * sizeof(float));
+			}
+			else {
+				for (size_t i = 0; i < n; i++) dcol[i] = scores[i * c + j];
+				write(dcol.data(), n * sizeof(double));
+			}
+		}
+
+		mult.clear();
+		scores.clear();
+	}
+};
+
+// Memory-mapped read-only access to a database.
+struct db_reader {
+	db_header h;
+	const char *base;
+	size_t size;
+	std::vector<const char *> group; // Start of the multipliers of each group
+	std::vector<int64_t> start; // start[g] is the index of the first row of group g; the last element is the number of rows
+
+	db_reader(const char * const file) {
+		const int fd = open(file, O_RDONLY);
+		struct stat st;
+		if (fd == -1 || fstat(fd, &st) == -1) {
+			perror(file);
+			exit(1);
+		}
+		size = st.st_size;
+		if (size < sizeof h) {
+			fprintf(stderr, "Not a database: %s\n", file);
+			exit(1);
+		}
+		base = (const char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED) {
+			perror(file);
+			exit(1);
+		}
+		close(fd);
+
+		memcpy(&h, base, sizeof h);
+		if (! h.valid()) {
+			fprintf(stderr, "Not a database: %s\n", file);
+			exit(1);
+		}
+
+		start.push_back(0);
+		for (size_t pos = sizeof h; pos < size; ) {
+			uint64_t n = 0;
+			if (size - pos >= sizeof n) memcpy(&n, base + pos, sizeof n);
+			pos += sizeof n;
+			if (pos > size || n > (size - pos) / h.row_bytes()) {
+				fprintf(stderr, "Truncated database: %s\n", file);
+				exit(1);
+			}
+			group.push_back(base + pos);
+			start.push_back(start.back() + n);
+			pos += n * h.row_bytes();
+		}
+	}
+
+	~db_reader() { munmap((void *)base, size); }
+
+	int64_t rows() const { return start.back(); }
+
+	// Returns the group containing row i.
+	size_t group_of(const int64_t i) const { return std::upper_bound(start.begin(), start.end(), i) - start.begin() - 1; }
+
+	uint128_t multiplier(const int64_t i) const {
+		const size_t g = group_of(i);
+		const char * const p = group[g] + (i - start[g]) * h.mult_bytes;
+		if (h.mult_bytes == 8) {
+			uint64_t x;
+			memcpy(&x, p, sizeof x);
+			return x;
+		}
+		uint128_t x;
+		memcpy(&x, p, sizeof x);
+		return x;
+	}
+
+	// Returns score column c of row i.
+	double score(const int c, const int64_t i) const {
+		const size_t g = group_of(i);
+		const int64_t n = start[g + 1] - start[g];
+		const char * const p = group[g] + n * h.mult_bytes + (c * n + i - start[g]) * h.score_bytes;
+		if (h.score_bytes == 4) {
+			float x;
+			memcpy(&x, p, sizeof x);
+			return x;
+		}
+		double x;
+		memcpy(&x, p, sizeof x);
+		return x;
+	}
+};
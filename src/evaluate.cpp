@@ -0,0 +1,415 @@
+/*  Written in 2019-2021 by Guy Steele and Sebastiano Vigna
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Evaluation of the blocks of a search, shared by search and sweep, which
+   include this file after spectral.cpp, dbformat.cpp and candidates.cpp.
+
+   A block_evaluator holds the tests of a configuration (modulus, type,
+   multiplier size and number of candidates) and the state of top-K mode,
+   and evaluates blocks of candidates, formatting the rows of the
+   multipliers passing the threshold; the output of a configuration thus
+   depends only on the options and on the configuration. */
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <unistd.h>
+
+// Only multipliers with a minimum spectral score larger than this value will be printed.
+const double threshold = 0.70;
+
+/* Candidates are evaluated in blocks of this size. Block k of a random search
+   uses the pseudorandom generator jumped k times, and blocks are printed in
+   order, so the output does not depend on the number of threads. */
+const int64_t block_size = 1 << 14;
+
+// Reads exactly n bytes; returns false on end of file.
+inline bool read_fully(int fd, void *buf, size_t n) {
+	for (char *p = (char *)buf; n > 0; ) {
+		const ssize_t r = read(fd, p, n);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+inline void write_fully(int fd, const void *buf, size_t n) {
+	for (const char *p = (const char *)buf; n > 0; ) {
+		const ssize_t w = write(fd, p, n);
+		if (w < 0 && errno == EINTR) continue;
+		if (w < 0) {
+			perror("write");
+			exit(1);
+		}
+		p += w;
+		n -= w;
+	}
+}
+
+/* Statistics on the figures of merit computed in each dimension (at lag
+   one): their number, their histogram, and the time spent computing them,
+   which is measured only for one candidate out of timing_sample to keep
+   overhead low. They are accumulated per block and merged when blocks are
+   printed; they describe the current run only, and are not checkpointed. */
+const int hist_bins = 20;
+const int timing_sample = 16;
+
+struct eval_stats {
+	int64_t count[dim_max + 1], timed[dim_max + 1], nanos[dim_max + 1];
+	int64_t hist[dim_max + 1][hist_bins]; // Bin b contains figures of merit in [b / hist_bins..(b + 1) / hist_bins), the last one also larger ones
+
+	void clear() { memset(this, 0, sizeof *this); }
+
+	void add(const double fm, const int d) {
+		count[d]++;
+		hist[d][max(0, min(hist_bins - 1, int(fm * hist_bins)))]++;
+	}
+
+	void merge(const eval_stats &s) {
+		for (int d = 0; d <= dim_max; d++) {
+			count[d] += s.count[d];
+			timed[d] += s.timed[d];
+			nanos[d] += s.nanos[d];
+			for (int b = 0; b < hist_bins; b++) hist[d][b] += s.hist[d][b];
+		}
+	}
+};
+
+/* Top-K mode keeps in memory only the best K candidates by harmonic or by
+   minimum score, using a bounded heap whose top is the worst candidate kept.
+   Once the heap is full, the key of its top is the bar a candidate must
+   beat to be kept: it can only rise, so candidates that cannot beat it are
+   rejected as soon as possible. Equal keys are ordered by candidate index,
+   so the final content of the heap does not depend on the evaluation
+   order. */
+struct top_entry {
+	double key;
+	int64_t c; // The index of the candidate
+	string out; // Its output line, or binary row
+};
+
+// True if x is better than y, so that the top of a priority_queue is the worst entry.
+struct better_entry {
+	bool operator()(const top_entry &x, const top_entry &y) const { return x.key > y.key || (x.key == y.key && x.c < y.c); }
+};
+
+struct top_heap {
+	size_t k = 0; // Zero if the heap is not in use
+	priority_queue<top_entry, vector<top_entry>, better_entry> q;
+
+	// Whether a candidate with the given key and index would be kept.
+	bool beats(const double key, const int64_t c) const {
+		return k != 0 && (q.size() < k || better_entry()({ key, c, "" }, q.top()));
+	}
+
+	void add(const top_entry &e) {
+		if (! beats(e.key, e.c)) return;
+		if (q.size() == k) q.pop();
+		q.push(e);
+	}
+
+	// Candidates with a key smaller than the bar cannot be kept.
+	double bar() const {
+		return k == 0 ? numeric_limits<double>::infinity() : q.size() < k ? -numeric_limits<double>::infinity() : q.top().key;
+	}
+
+	// Whether the heap is in use and full, so that its bar is meaningful
+	bool full() const { return k != 0 && q.size() == k; }
+};
+
+// Output and statistics of a completed block waiting to be printed
+struct block_result {
+	string out;
+	int64_t evaluated, accepted, rejected[dim_max + 1], fallbacks, mismatches;
+	int64_t pruned; // Candidates stopped by the bars of top-K mode, which is incompatible with worker processes (not serialized)
+	eval_stats stats;
+
+	// Serialization for worker processes
+	void write(int fd) const {
+		int64_t h[dim_max + 6] = { evaluated, accepted, fallbacks, mismatches, (int64_t)out.size() };
+		copy(rejected, rejected + dim_max + 1, h + 5);
+		write_fully(fd, h, sizeof h);
+		write_fully(fd, &stats, sizeof stats);
+		write_fully(fd, out.data(), out.size());
+	}
+
+	bool read(int fd) {
+		int64_t h[dim_max + 6];
+		if (! read_fully(fd, h, sizeof h) || ! read_fully(fd, &stats, sizeof stats)) return false;
+		evaluated = h[0];
+		accepted = h[1];
+		fallbacks = h[2];
+		mismatches = h[3];
+		copy(h + 5, h + dim_max + 6, rejected);
+		out.resize(h[4]);
+		return read_fully(fd, &out[0], h[4]);
+	}
+};
+
+// The options of a search that do not depend on the configuration
+struct search_options {
+	uint64_t seed = 0;
+	int max_dim = 0, lags = 1;
+	int order[dim_max]; // Evaluation order of the dimensions
+	int score_bytes = 0; // Bytes per score of binary output, or zero for text output
+	bool prune = false, fixed = false, fp = false, check = false, incremental = false;
+	int64_t top_harm = 0, top_min = 0; // Candidates kept in top-K mode by harmonic and minimum score (zero if not)
+
+	/* Sets the evaluation order from a comma-separated permutation of the
+	   dimensions from 2 to max_dim, or to the natural order if dim_order is
+	   NULL; aborts if the permutation is invalid. */
+	void set_order(const char * const dim_order) {
+		for (int i = 0; i < max_dim - 1; i++) order[i] = i + 2;
+		if (dim_order == NULL) return;
+
+		bool seen[dim_max + 1] = {};
+		int n = 0;
+		char *end;
+		for (const char *p = dim_order; *p; ) {
+			const int d = strtol(p, &end, 10);
+			if (end == p || (*end && *end != ',') || d < 2 || d > max_dim || seen[d]) {
+				cerr << "Invalid dimension order: " << dim_order << endl;
+				exit(1);
+			}
+			seen[d] = true;
+			order[n++] = d;
+			p = *end ? end + 1 : end;
+		}
+		if (n != max_dim - 1) {
+			cerr << "The dimension order must contain all dimensions from 2 to " << max_dim << endl;
+			exit(1);
+		}
+	}
+
+	bool top() const { return top_harm != 0 || top_min != 0; }
+};
+
+struct block_evaluator {
+	const search_options &opt;
+	const bool mcg;
+	const int multiplier_size;
+	const int64_t iters;
+	const candidate_strategy strategy;
+	vector<spectral_test> tests; // tests[l - 1] is the test for lag l
+	double harm_norm = 0;
+	double max_rest = 0; // Upper bound on the weighted sum of all figures of merit
+
+	/* In top-K mode, the heaps are protected by top_mutex, and their bars are
+	   published to all threads. The harmonic score is bounded using the
+	   upper bounds on the figures of merit not computed yet given by
+	   spectral_test::max_fm. Local searches need the scores of all
+	   candidates passing the threshold, so they do not prune. */
+	mutex top_mutex;
+	top_heap harm_heap, min_heap;
+	atomic<double> harm_bar, min_bar;
+	const bool top_prune;
+
+	block_evaluator(const search_options &opt, const ZZ &mod, const bool mcg, const int multiplier_size, const int64_t iters, const candidate_strategy strategy) :
+		opt(opt), mcg(mcg), multiplier_size(multiplier_size), iters(iters), strategy(strategy),
+		top_prune(opt.top() && (strategy == UNIFORM || strategy == EXHAUSTIVE || strategy == STRATIFIED)) {
+		for (int l = 1; l <= opt.lags; l++) tests.emplace_back(mod, l, mcg);
+		for (int d = 2; d <= opt.max_dim; d++) {
+			harm_norm += 1. / (d - 1);
+			max_rest += tests[0].max_fm[d - 2] / (d - 1);
+		}
+		harm_heap.k = opt.top_harm;
+		min_heap.k = opt.top_min;
+		harm_bar = harm_heap.bar();
+		min_bar = min_heap.bar();
+	}
+
+	// Whether lattices are actually reduced using fixed-width arithmetic
+	bool fixed() const { return opt.fixed && fixed_reducer(tests[0].mod).usable(); }
+
+	// The header of binary output
+	db_header header() const {
+		db_header h;
+		h.mcg = mcg;
+		h.lagged = opt.lags > 1;
+		h.mult_bytes = multiplier_size <= 64 ? 8 : 16;
+		h.score_bytes = opt.score_bytes;
+		h.state = tests[0].state_bits();
+		h.msize = multiplier_size;
+		h.max_dim = opt.max_dim;
+		return h;
+	}
+
+	// Evaluators and candidate generator for a thread or worker process
+	vector<spectral_eval> evals() const {
+		vector<spectral_eval> evals;
+		for (int l = 0; l < opt.lags; l++) evals.emplace_back(tests[l], opt.fixed, opt.check, opt.incremental, opt.fp);
+		return evals;
+	}
+
+	candidate_generator generator() const { return candidate_generator(strategy, opt.seed, multiplier_size); }
+
+	// Returns the output line (or binary row) of multiplier a.
+	string row(const ZZ &a, const double * const cur_fm, const double min_fm, const double min_lag, const double harm_score) const {
+		const int max_dim = opt.max_dim;
+
+		if (opt.score_bytes != 0) {
+			double scores[dim_max + 2];
+			int n = 0;
+			scores[n++] = min_fm;
+			if (opt.lags > 1) scores[n++] = min_lag;
+			scores[n++] = harm_score;
+			for (int d = 2; d <= max_dim; d++) scores[n++] = cur_fm[d - 2];
+			string row;
+			db_row(row, conv<uint128_t>(a), scores, n);
+			return row;
+		}
+
+		char buf[32];
+		ostringstream out;
+		if (opt.lags > 1) {
+			snprintf(buf, sizeof buf, "%8.6f\t%8.6f\t", min_fm, min_lag);
+			out << buf;
+		}
+		else {
+			snprintf(buf, sizeof buf, "%8.6f\t", min_fm);
+			out << buf;
+		}
+
+		snprintf(buf, sizeof buf, "%8.6f\t", harm_score);
+		out << buf << a << "\t" << "0x" << hex(a);
+		for (int d = 2; d <= max_dim; d++) {
+			snprintf(buf, sizeof buf, "\t%8.6f", cur_fm[d - 2]);
+			out << buf;
+		}
+		out << "\n";
+		return out.str();
+	}
+
+	// Adds a candidate to the heaps of top-K mode, updating the bars.
+	void keep(const double harm_score, const double min_fm, const int64_t c, const string &row) {
+		lock_guard<mutex> lock(top_mutex);
+		harm_heap.add({ harm_score, c, row });
+		min_heap.add({ min_fm, c, row });
+		harm_bar.store(harm_heap.bar(), memory_order_relaxed);
+		min_bar.store(min_heap.bar(), memory_order_relaxed);
+	}
+
+	// Empties the heaps of top-K mode, returning their union in candidate order.
+	map<int64_t, string> kept() {
+		map<int64_t, string> kept;
+		for (top_heap *h : { &harm_heap, &min_heap })
+			for (; ! h->q.empty(); h->q.pop()) kept[h->q.top().c] = h->q.top().out;
+		return kept;
+	}
+
+	// Evaluates block k, using the generator r.
+	void evaluate(vector<spectral_eval> &evals, candidate_generator &cg, const int64_t k, xoshiro256 &r, block_result &res) {
+		const int max_dim = opt.max_dim;
+		double cur_fm[dim_max];
+		spectral_eval &eval = evals[0];
+		ostringstream out;
+		res.accepted = res.pruned = 0;
+		fill(res.rejected, res.rejected + dim_max + 1, 0);
+		res.stats.clear();
+		const int64_t end = min(iters, (k + 1) * block_size);
+		cg.start();
+
+		for (int64_t c = k * block_size; c < end; c++) {
+			/* We generate only full-period multipliers of maximum potency, and,
+			   in the multiplicative case, maximum-period multipliers whose
+			   lattice of upper bits (minus the lowest two) is a translated
+			   and scaled version of the lattice on all bits. In both cases,
+			   these are exactly the multipliers whose residue modulo 8 is 5. */
+			const ZZ &a = cg.next(c, r);
+
+			int reject_dim = 0;
+			bool pruned = false; // Whether the candidate has been stopped by the bars of top-K mode before falling below the threshold
+
+			eval.multiplier(a);
+			const bool timed = c % timing_sample == 0;
+			// In top-K mode, the minimum and the weighted sum of the figures of merit computed so far, and a bound on the weighted sum of the others
+			double part_min = numeric_limits<double>::infinity(), part_harm = 0, rest = max_rest;
+
+			for (int j = 0; j < max_dim - 1; j++) {
+				const int d = opt.order[j];
+				if (timed) {
+					const auto start = chrono::steady_clock::now();
+					cur_fm[d - 2] = eval.fm(d);
+					res.stats.nanos[d] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+					res.stats.timed[d]++;
+				}
+				else cur_fm[d - 2] = eval.fm(d);
+				res.stats.add(cur_fm[d - 2], d);
+				if (cur_fm[d - 2] < threshold && reject_dim == 0) {
+					reject_dim = d;
+					if (opt.prune) break;
+				}
+				if (top_prune) {
+					part_min = min(part_min, cur_fm[d - 2]);
+					part_harm += cur_fm[d - 2] / (d - 1);
+					rest -= tests[0].max_fm[d - 2] / (d - 1);
+					// The candidate can be kept by neither heap (the bound on the harmonic score is enlarged slightly to compensate for rounding errors)
+					if (part_min < min_bar.load(memory_order_relaxed) && (part_harm + rest) / harm_norm * (1 + 1E-9) < harm_bar.load(memory_order_relaxed)) {
+						// Candidates already below the threshold are counted as rejected
+						pruned = reject_dim == 0;
+						break;
+					}
+				}
+			}
+
+			if (pruned) {
+				res.pruned++;
+				cg.feedback(false, 0, r);
+				continue;
+			}
+
+			if (reject_dim != 0) {
+				res.rejected[reject_dim]++;
+				cg.feedback(false, 0, r);
+				continue;
+			}
+
+			res.accepted++;
+			double min_fm = numeric_limits<double>::infinity(), harm_score = 0;
+
+			for (int d = 2; d <= max_dim; d++) {
+				min_fm = min(min_fm, cur_fm[d - 2]);
+				harm_score += cur_fm[d - 2] / (d - 1);
+			}
+
+			harm_score /= harm_norm;
+			cg.feedback(true, harm_score, r);
+
+			if (opt.top()) {
+				lock_guard<mutex> lock(top_mutex);
+				if (! harm_heap.beats(harm_score, c) && ! min_heap.beats(min_fm, c)) continue;
+			}
+
+			// Lagged scores are computed only for multipliers passing the threshold
+			double min_lag = 1;
+			for (int l = 1; l < opt.lags; l++) {
+				evals[l].multiplier(a);
+				for (int d = 2; d <= max_dim; d++) min_lag = min(min_lag, evals[l].fm(d));
+			}
+
+			if (opt.top()) keep(harm_score, min_fm, c, row(a, cur_fm, min_fm, min_lag, harm_score));
+			else out << row(a, cur_fm, min_fm, min_lag, harm_score);
+		}
+
+		res.out = out.str();
+		res.evaluated = end - k * block_size;
+		res.fallbacks = res.mismatches = 0;
+		for (auto &e : evals) {
+			res.fallbacks += e.fallbacks;
+			res.mismatches += e.mismatches;
+			e.fallbacks = e.mismatches = 0;
+		}
+	}
+};
@@ -0,0 +1,144 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Native replacement for ../python/filter.sh and ../python/filter.py.
+   Joins line by line a database TYPE-STATE-BITS with the databases
+   TYPE-STATE-i-BITS of figures of merit for lags i = 2, 3, ... of the same
+   multipliers, and writes to TYPE-STATE-BITS-L the aggregate format with the
+   minimum lagged score. Inputs are memory mapped, and lines are split using
+   memchr(), which is vectorized by the C library. Scores are parsed as
+   fixed-point numbers with six decimal places, so the output is identical
+   to that of filter.py. */
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+#include "textdb.cpp"
+
+static void filter(const string &name, const int lags) {
+	// TYPE-STATE-BITS -> TYPE-STATE-i-BITS
+	const size_t dash = name.rfind('-');
+	if (dash == string::npos) {
+		cerr << "Database names must have the form TYPE-STATE-BITS: " << name << endl;
+		exit(1);
+	}
+
+	text_file base(name);
+	vector<text_file *> lagged;
+	for (int i = 2; i <= lags; i++) lagged.push_back(new text_file(name.substr(0, dash) + "-" + to_string(i) + name.substr(dash)));
+
+	const string out_name = name + "-L";
+	FILE * const out = fopen(out_name.c_str(), "w");
+	if (out == NULL) {
+		perror(out_name.c_str());
+		exit(1);
+	}
+
+	vector<const char *> field, lfield;
+	string line;
+	char buf[64];
+	const char *s, *e;
+
+	while (base.next(s, e)) {
+		split(s, e, field);
+		if (field.size() < 5) base.error("Too few columns");
+		const int64_t min_fm = parse_score(field[0], field[1] - 1), harm = parse_score(field[1], field[2] - 1);
+		if (min_fm < 0 || harm < 0) base.error("Invalid score");
+		const char * const dec = field[2];
+		const size_t dec_len = field[3] - 1 - dec;
+
+		int64_t min_lag = 1000000;
+		for (text_file *l : lagged) {
+			const char *ls, *le;
+			if (! l->next(ls, le)) l->error("Missing line");
+			split(ls, le, lfield);
+			if (lfield.size() < 4 || (size_t)(lfield[3] - 1 - lfield[2]) != dec_len || memcmp(lfield[2], dec, dec_len) != 0) l->error("Multiplier does not match the base database");
+			const int64_t x = parse_score(lfield[0], lfield[1] - 1);
+			if (x < 0) l->error("Invalid score");
+			min_lag = min(min_lag, x);
+		}
+
+		line.clear();
+		char *b = print_score(buf, min_fm);
+		*b++ = '\t';
+		b = print_score(b, min_lag);
+		*b++ = '\t';
+		b = print_score(b, harm);
+		*b++ = '\t';
+		line.append(buf, b);
+		// Multiplier in decimal and hexadecimal, and figures of merit
+		line.append(dec, e);
+		line += '\n';
+		fwrite(line.data(), 1, line.size(), out);
+	}
+
+	for (text_file *l : lagged) {
+		const char *ls, *le;
+		if (l->next(ls, le)) l->error("Extra lines");
+		delete l;
+	}
+
+	if (fclose(out) != 0) {
+		perror(out_name.c_str());
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int threads = 1, lags = 8, opt;
+
+	while ((opt = getopt(argc, argv, "+j:l:")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) threads = thread::hardware_concurrency();
+			break;
+		case 'l':
+			lags = atoi(optarg);
+			if (lags < 2) {
+				cerr << "The number of lags must be at least two" << endl;
+				exit(1);
+			}
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 2) {
+		cerr << "USAGE: " << argv[0] << " [-j THREADS] [-l LAGS] TYPE-STATE-BITS..." << endl << endl;
+		cerr << "For each database TYPE-STATE-BITS, joins it line by line with the" << endl;
+		cerr << "databases TYPE-STATE-i-BITS for lags i from 2 to LAGS (default: 8)" << endl;
+		cerr << "and writes to TYPE-STATE-BITS-L the aggregate format generated by" << endl;
+		cerr << "../python/filter.sh: minimum spectral score, minimum lagged score" << endl;
+		cerr << "(the minimum of 1 and of the minimum spectral scores for all lags)," << endl;
+		cerr << "harmonic spectral score, multiplier in decimal and hexadecimal and" << endl;
+		cerr << "figures of merit. Databases are processed by the given number of" << endl;
+		cerr << "threads (0 means all available cores)." << endl;
+		exit(1);
+	}
+
+	atomic<int> next(1);
+	auto worker = [&]() {
+		for (int i; (i = next++) < argc; ) {
+			cerr << "Filtering " << string(argv[i]) + "\n";
+			filter(argv[i], lags);
+		}
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+	for (auto &t : pool) t.join();
+}
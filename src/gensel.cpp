@@ -0,0 +1,279 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Native replacement for ../python/gensel.py, with the same output, using
+   two streaming passes over each aggregate file and constant memory.
+
+   Scores have six decimal places, so exact quantiles can be computed from
+   histograms with one bucket per possible value. The first pass computes
+   the quantile of minimum lagged scores; the second pass computes the
+   0.999 quantiles of minimum and harmonic scores and, for each possible
+   minimum (harmonic) score, the first row with the best harmonic (minimum)
+   score, from which the best rows above the quantiles follow. Quantiles
+   are interpolated linearly, as pandas does. */
+
+#include <iostream>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+#include "textdb.cpp"
+
+typedef __uint128_t uint128_t;
+
+// Aggregate files and the high bits that must be set in their multipliers (see gensel.py)
+static const struct {
+	const char *name;
+	int hi_mask;
+} configs[] = {
+	{ "LCG-32-16", 3 }, { "LCG-32-17", 3 }, { "LCG-32-18", 3 }, { "LCG-32-19", 3 }, { "LCG-32-24", 3 }, { "LCG-32-32", 0 },
+	{ "MCG-32-15", 3 }, { "MCG-32-16", 3 }, { "MCG-32-17", 3 }, { "MCG-32-18", 3 }, { "MCG-32-19", 3 }, { "MCG-32-24", 3 }, { "MCG-32-32", 0 },
+	{ "LCG-64-32", 3 }, { "LCG-64-33", 3 }, { "LCG-64-34", 3 }, { "LCG-64-35", 3 }, { "LCG-64-48", 0 }, { "LCG-64-64", 0 },
+	{ "MCG-64-31", 3 }, { "MCG-64-32", 3 }, { "MCG-64-33", 3 }, { "MCG-64-34", 3 }, { "MCG-64-35", 3 }, { "MCG-64-48", 0 }, { "MCG-64-64", 0 },
+	{ "LCG-128-64", 3 }, { "LCG-128-65", 3 }, { "LCG-128-66", 3 }, { "LCG-128-67", 3 }, { "LCG-128-68", 3 }, { "LCG-128-69", 3 }, { "LCG-128-70", 3 },
+	{ "LCG-128-71", 3 }, { "LCG-128-72", 3 }, { "LCG-128-80", 3 }, { "LCG-128-96", 0 }, { "LCG-128-128", 0 },
+	{ "MCG-128-63", 3 }, { "MCG-128-64", 3 }, { "MCG-128-65", 3 }, { "MCG-128-66", 3 }, { "MCG-128-67", 3 }, { "MCG-128-68", 3 }, { "MCG-128-69", 3 },
+	{ "MCG-128-70", 3 }, { "MCG-128-71", 3 }, { "MCG-128-72", 3 }, { "MCG-128-80", 3 }, { "MCG-128-96", 0 }, { "MCG-128-128", 0 },
+};
+
+// Scores are stored in millionths, and must not be larger than this value.
+const int64_t score_max = 2000000;
+
+// Histogram of the scores of a column
+struct histogram {
+	vector<int64_t> count;
+	int64_t n = 0;
+
+	histogram() : count(score_max + 1) {}
+
+	void add(const int64_t x) {
+		count[x]++;
+		n++;
+	}
+
+	// Returns the k-th smallest score (starting from zero).
+	double kth(int64_t k) const {
+		for (int64_t x = 0; ; x++) if ((k -= count[x]) < 0) return x / 1E6;
+	}
+
+	// Returns the q-quantile with linear interpolation, as numpy (and thus pandas) does.
+	double quantile(const double q) const {
+		const double index = n * q + (1 + q * -1) - 1; // The expression used by numpy
+		const int64_t prev = floor(index), next = min(prev + 1, n - 1);
+		const double t = index - prev, a = kth(prev), b = kth(next), diff = b - a;
+		return t >= 0.5 ? b - diff * (1 - t) : a + diff * t;
+	}
+};
+
+/* For each value of a score (the key), the first row with the largest value
+   of another score, identified by its offset in the file. */
+struct best_by_key {
+	vector<int32_t> best;
+	vector<int64_t> offset;
+
+	best_by_key() : best(score_max + 1, -1), offset(score_max + 1, -1) {}
+
+	void add(const int64_t key, const int64_t score, const int64_t off) {
+		if (score > best[key]) {
+			best[key] = score;
+			offset[key] = off;
+		}
+	}
+
+	// Returns the offset of the first row with the largest score among those with key at least min_key, or -1.
+	int64_t get(const double min_key) const {
+		int64_t b = -1, off = -1;
+		for (int64_t k = max(0., ceil(min_key * 1E6) - 1); k <= score_max; k++) {
+			if (k / 1E6 < min_key || best[k] < b) continue;
+			if (best[k] > b || offset[k] < off) {
+				b = best[k];
+				off = offset[k];
+			}
+		}
+		return off;
+	}
+};
+
+static uint128_t parse_multiplier(text_file &f, const char *s, const char * const e) {
+	uint128_t a = 0;
+	if (s == e) f.error("Invalid multiplier");
+	for (; s < e; s++) {
+		if (*s < '0' || *s > '9') f.error("Invalid multiplier");
+		a = a * 10 + (*s - '0');
+	}
+	return a;
+}
+
+static int64_t score(text_file &f, const vector<const char *> &field, const int i) {
+	const int64_t x = parse_score(field[i], field[i + 1] - 1);
+	if (x < 0 || x > score_max) f.error("Invalid score");
+	return x;
+}
+
+// Computes the selection for a configuration, returning the output for standard output and standard error.
+static void select_best(const int c, const double quantile, const set<string> &blacklist, string &out, string &err) {
+	const string name = string(configs[c].name) + "-L";
+	text_file f(name);
+	vector<const char *> field;
+	const char *s, *e;
+
+	// Mask of high bits, aligned with the most significant bit of the first multiplier
+	uint128_t mask = 0;
+	if (configs[c].hi_mask != 0 && f.next(s, e)) {
+		split(s, e, field);
+		if (field.size() < 6) f.error("Too few columns");
+		const uint128_t d = parse_multiplier(f, field[3], field[4] - 1);
+		int msb = 127, hi_msb = 31 - __builtin_clz(configs[c].hi_mask);
+		while (msb > 0 && (d >> msb) == 0) msb--;
+		mask = (uint128_t)configs[c].hi_mask << (msb - hi_msb);
+		f.rewind();
+	}
+
+	// First pass: quantile of the minimum lagged score
+	histogram lag;
+	while (f.next(s, e)) {
+		split(s, e, field);
+		if (field.size() < 6) f.error("Too few columns");
+		if ((parse_multiplier(f, field[3], field[4] - 1) & mask) != mask) continue;
+		lag.add(score(f, field, 1));
+	}
+
+	if (lag.n == 0) {
+		cerr << name << ": no candidates" << endl;
+		return;
+	}
+
+	const double lag_threshold = lag.quantile(quantile);
+
+	// Second pass: quantiles of the minimum and harmonic score, and best rows
+	histogram min_fm, harm;
+	best_by_key best_harm, best_min; // Best harmonic score by minimum score, and vice versa
+	const bool lcg = name.compare(0, 3, "LCG") == 0;
+	f.rewind();
+	while (f.next(s, e)) {
+		split(s, e, field);
+		if ((parse_multiplier(f, field[3], field[4] - 1) & mask) != mask) continue;
+		if (score(f, field, 1) / 1E6 < lag_threshold) continue;
+		// Discard candidates with known problems in high dimension
+		if (blacklist.count((lcg ? "LCG\t" : "MCG\t") + string(field[4], field[5] - 1))) continue;
+		const int64_t m = score(f, field, 0), h = score(f, field, 2);
+		min_fm.add(m);
+		harm.add(h);
+		best_harm.add(m, h, s - f.base);
+		best_min.add(h, m, s - f.base);
+	}
+
+	if (min_fm.n == 0) {
+		cerr << name << ": no candidates" << endl;
+		return;
+	}
+
+	// Returns the hexadecimal multiplier at the given offset
+	auto hex = [&](const int64_t off) {
+		const char * const s = f.base + off, * const e = (const char *)memchr(s, '\n', f.end - s);
+		split(s, e == NULL ? f.end : e, field);
+		return string(field[4], field[5] - 1);
+	};
+
+	out += name + "\t" + hex(best_harm.get(-INFINITY)) + "\n";
+	out += name + "\t" + hex(best_harm.get(min_fm.quantile(.999))) + "\n\n\n";
+	err += name + "\t" + hex(best_min.get(-INFINITY)) + "\n";
+	err += name + "\t" + hex(best_min.get(harm.quantile(.999))) + "\n\n\n";
+}
+
+int main(int argc, char *argv[]) {
+	int threads = 1, opt;
+	const char *blacklist_file = NULL;
+
+	while ((opt = getopt(argc, argv, "+j:b:")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) threads = thread::hardware_concurrency();
+			break;
+		case 'b':
+			blacklist_file = optarg;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 2) {
+		cerr << "USAGE: " << argv[0] << " [-j THREADS] [-b BLACKLIST] QUANTILE [TYPE-STATE-BITS...]" << endl << endl;
+		cerr << "Selects the best multipliers from the aggregate files generated by" << endl;
+		cerr << "filter, like ../python/gensel.py: for each type and size (or for" << endl;
+		cerr << "the given ones only) prints on standard output the best multiplier" << endl;
+		cerr << "by harmonic score, and the best one by harmonic score within the" << endl;
+		cerr << "first millile by minimum score, and on standard error the same" << endl;
+		cerr << "for minimum score. Only multipliers whose minimum lagged score is" << endl;
+		cerr << "at least the given quantile are considered. BLACKLIST contains" << endl;
+		cerr << "multipliers with known problems to be discarded, one per line" << endl;
+		cerr << "in the form TYPE<TAB>HEX (see ../python/blacklist.txt)." << endl;
+		cerr << "Files are processed by the given number of threads (0 means" << endl;
+		cerr << "all available cores)." << endl;
+		exit(1);
+	}
+
+	char *end;
+	const double quantile = strtod(argv[1], &end);
+	if (*end || quantile < 0 || quantile > 1) {
+		cerr << "Invalid quantile: " << argv[1] << endl;
+		exit(1);
+	}
+
+	set<string> blacklist;
+	if (blacklist_file != NULL) {
+		ifstream in(blacklist_file);
+		if (! in) {
+			perror(blacklist_file);
+			exit(1);
+		}
+		for (string line; getline(in, line); ) if (! line.empty()) blacklist.insert(line);
+	}
+
+	const int n = sizeof configs / sizeof *configs;
+	vector<int> selected;
+	for (int c = 0; c < n; c++) {
+		bool found = argc == 2;
+		for (int i = 2; i < argc; i++) found |= strcmp(argv[i], configs[c].name) == 0;
+		if (found) selected.push_back(c);
+	}
+
+	for (int i = 2; i < argc; i++) {
+		int c = 0;
+		while (c < n && strcmp(argv[i], configs[c].name) != 0) c++;
+		if (c == n) {
+			cerr << "Unknown type and size: " << argv[i] << endl;
+			exit(1);
+		}
+	}
+
+	vector<string> out(selected.size()), err(selected.size());
+	atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i; (i = next++) < selected.size(); ) select_best(selected[i], quantile, blacklist, out[i], err[i]);
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+	for (auto &t : pool) t.join();
+
+	for (size_t i = 0; i < selected.size(); i++) {
+		fputs(out[i].c_str(), stdout);
+		fputs(err[i].c_str(), stderr);
+	}
+}
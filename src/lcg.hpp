@@ -0,0 +1,433 @@
+/*  Written in 2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Header-only LCGs and MCGs with power-of-two moduli using the multipliers
+   selected by the code in this repository.
+
+   congruential_engine<STATE, MSIZE, MCG> has a state of STATE bits (32, 64
+   or 128) and a multiplier of MSIZE bits taken from the table below; it is
+   an LCG (with an odd increment) or, if MCG is true, an MCG (with an odd
+   state). It satisfies the UniformRandomBitGenerator requirements, and
+   returns the upper half of the state, as lower bits have short periods.
+
+   For 128-bit states, multiplying by a multiplier of at most 64 bits needs
+   a 64x64->128-bit multiplication and a 64x64->64-bit one, and multiplying
+   by a 65-bit multiplier (whose upper bit is one) needs an additional sum:
+   this is the structure that makes these multipliers computationally easy,
+   and the engine uses it explicitly.
+
+   Use fill() to generate many values at once: it keeps the state in
+   registers and avoids the per-call overhead of operator(). jump() and
+   discard() advance the state by n steps in O(log n) time, and
+   leapfrog_engine splits a stream into interleaved substreams.
+
+   A single engine is limited by the latency of multiplication, as each step
+   depends on the previous one. multi_engine<E, N> advances N independent
+   streams of the engine E at once, using AVX-512 or AVX2 (if enabled at
+   compile time, e.g., with -march=native) for states of 64 and 128 bits,
+   and a portable loop, which the compiler can interleave or vectorize,
+   otherwise. See multibench.cpp for a throughput comparison. */
+
+#ifndef LCG_HPP
+#define LCG_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace lcg {
+
+struct multiplier_entry {
+	bool mcg;
+	int state_bits, mult_bits;
+	uint64_t hi, lo; // The multiplier is hi * 2^64 + lo
+};
+
+/* Selected multipliers. The generated part of this table can be rebuilt from
+   the output of ../python/gensel.py (or ../src/gensel) using
+   ../python/gentable.py, which uses the second choice of best_harmonic.txt,
+   as in the tables of the paper. */
+inline constexpr multiplier_entry multipliers[] = {
+// BEGIN GENERATED TABLE
+	{ false, 32, 32, 0x0, 0xadb4a92d }, // LCG-32-32 (Java 17 L32X64)
+	{ false, 64, 64, 0x0, 0xd1342543de82ef95 }, // LCG-64-64 (Java 17 L64X*)
+	{ false, 128, 65, 0x1, 0xd605bbb58c8abbfd }, // LCG-128-65 (Java 17 L128X*)
+	{ true, 128, 64, 0x0, 0xda942042e4dd58b5 }, // MCG-128-64
+// END GENERATED TABLE
+};
+
+// Returns the selected multiplier for the given parameters (compilation fails if there is none).
+constexpr __uint128_t multiplier(const bool mcg, const int state_bits, const int mult_bits) {
+	for (const auto &m : multipliers)
+		if (m.mcg == mcg && m.state_bits == state_bits && m.mult_bits == mult_bits) return (__uint128_t)m.hi << 64 | m.lo;
+	throw "No multiplier available for these parameters";
+}
+
+/* Replaces the affine map x -> mult * x + add modulo 2^k (the width of T)
+   with its n-th power by square-and-multiply, so jumping ahead n steps
+   takes O(log n) multiplications. This computes a^n and c(a^n - 1)/(a - 1)
+   without divisions, which would not be possible modulo 2^k. */
+template<typename T> constexpr void affine_power(T &mult, T &add, __uint128_t n) {
+	T rm = 1, ra = 0;
+	for (; n != 0; n >>= 1) {
+		if (n & 1) {
+			rm *= mult;
+			ra = ra * mult + add;
+		}
+		add = add * mult + add;
+		mult *= mult;
+	}
+	mult = rm;
+	add = ra;
+}
+
+template<int STATE> struct state_traits;
+template<> struct state_traits<32> { typedef uint32_t state_type; typedef uint16_t result_type; };
+template<> struct state_traits<64> { typedef uint64_t state_type; typedef uint32_t result_type; };
+template<> struct state_traits<128> { typedef __uint128_t state_type; typedef uint64_t result_type; };
+
+template<int STATE, int MSIZE, bool MCG = false, __uint128_t MULTIPLIER = multiplier(MCG, STATE, MSIZE)>
+class congruential_engine {
+public:
+	typedef typename state_traits<STATE>::state_type state_type;
+	typedef typename state_traits<STATE>::result_type result_type;
+
+	static constexpr int state_bits = STATE, mult_bits = MSIZE;
+	static constexpr bool mcg = MCG;
+	static constexpr __uint128_t multiplier = MULTIPLIER;
+	static constexpr state_type a = (state_type)MULTIPLIER;
+	static_assert(MSIZE <= STATE && (MSIZE == 128 || MULTIPLIER >> MSIZE == 0), "The multiplier does not fit in MSIZE bits");
+	static_assert(MULTIPLIER % 8 == 5, "The multiplier must be congruent to 5 modulo 8");
+
+	// The increment is made odd for LCGs and ignored for MCGs; the state is made odd for MCGs.
+	explicit congruential_engine(const state_type seed = 1, const state_type increment = 1) : x(MCG ? seed | 1 : seed), c(MCG ? 0 : increment | 1) {}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		x = step(x, c);
+		return output(x);
+	}
+
+	// Advances the state by n steps in O(log n) time.
+	void discard(unsigned long long n) { jump(n); }
+
+	void jump(const __uint128_t n) {
+		state_type m = a, s = c;
+		affine_power(m, s, n);
+		x = x * m + s;
+	}
+
+	// Fills [p..p + n) with the next n outputs.
+	void fill(result_type * const p, const size_t n) {
+		state_type s = x;
+		for (size_t i = 0; i < n; i++) {
+			s = step(s, c);
+			p[i] = output(s);
+		}
+		x = s;
+	}
+
+	// Fills a contiguous range of result_type (e.g., std::vector or std::span).
+	template<typename R> void fill(R &&r) { fill(std::data(r), std::size(r)); }
+
+	state_type state() const { return x; }
+	state_type increment() const { return c; }
+
+	bool operator==(const congruential_engine &o) const { return x == o.x && c == o.c; }
+	bool operator!=(const congruential_engine &o) const { return ! (*this == o); }
+
+protected:
+	template<class, int> friend class multi_engine;
+	template<class> friend class leapfrog_engine;
+
+	state_type x, c;
+
+	static result_type output(const state_type s) { return s >> STATE / 2; }
+
+	static state_type step(const state_type s, const state_type c) {
+		if constexpr (STATE == 128 && MSIZE <= 64) {
+			// One 64x64->128-bit and one 64x64->64-bit multiplication
+			const uint64_t lo = s, hi = s >> 64;
+			return ((__uint128_t)lo * (uint64_t)a) + ((__uint128_t)(hi * (uint64_t)a) << 64) + c;
+		}
+		else if constexpr (STATE == 128 && MSIZE == 65 && MULTIPLIER >> 64 == 1) {
+			// As above, plus the sum of the lower half of the state, shifted
+			const uint64_t lo = s, hi = s >> 64;
+			return ((__uint128_t)lo * (uint64_t)a) + ((__uint128_t)(hi * (uint64_t)a + lo) << 64) + c;
+		}
+		else return s * a + c;
+	}
+};
+
+/* Leapfrog splitting: the outputs of an engine E with indices j, j + k,
+   j + 2k, ... (counting from the next output of the engine), so k engines
+   with j = 0, 1, ..., k - 1 partition its outputs. The result is itself a
+   congruential generator with multiplier a^k, whose quality is measured by
+   the spectral test with lag k (see leapfrog.cpp). For block splitting into
+   disjoint segments, use jump() or multi_engine instead. */
+template<class E> class leapfrog_engine {
+public:
+	typedef typename E::state_type state_type;
+	typedef typename E::result_type result_type;
+
+	leapfrog_engine(E e, const __uint128_t k, const __uint128_t j) : m(E::a), s(e.increment()) {
+		e.jump(j + 1);
+		x = e.state();
+		affine_power(m, s, k);
+	}
+
+	static constexpr result_type min() { return E::min(); }
+	static constexpr result_type max() { return E::max(); }
+
+	result_type operator()() {
+		const result_type r = E::output(x);
+		x = x * m + s;
+		return r;
+	}
+
+	void discard(unsigned long long n) { jump(n); }
+
+	void jump(const __uint128_t n) {
+		state_type mn = m, sn = s;
+		affine_power(mn, sn, n);
+		x = x * mn + sn;
+	}
+
+	// The multiplier and the increment of the leapfrogged generator
+	state_type multiplier() const { return m; }
+	state_type increment() const { return s; }
+
+private:
+	state_type m, s, x; // x is the state whose output will be returned next
+};
+
+namespace detail {
+
+/* Operations on vectors of 64-bit lanes used by multi_engine. Products of
+   64-bit lanes are computed from 32x32->64-bit products, as AVX-512 has no
+   64x64->128-bit multiplication, and AVX2 has no 64-bit multiplication. */
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#define LCG_SIMD
+struct simd {
+	typedef __m512i v;
+	static constexpr int lanes = 8;
+	static v load(const uint64_t * const p) { return _mm512_loadu_si512(p); }
+	static void store(uint64_t * const p, const v x) { _mm512_storeu_si512(p, x); }
+	// Stores the upper 32 bits of each lane
+	static void store_hi32(uint32_t * const p, const v x) { _mm256_storeu_si256((__m256i *)p, _mm512_cvtepi64_epi32(_mm512_srli_epi64(x, 32))); }
+	static v set1(const uint64_t x) { return _mm512_set1_epi64(x); }
+	static v add(const v x, const v y) { return _mm512_add_epi64(x, y); }
+	static v and_(const v x, const v y) { return _mm512_and_si512(x, y); }
+	static v or_(const v x, const v y) { return _mm512_or_si512(x, y); }
+	static v andnot(const v x, const v y) { return _mm512_andnot_si512(x, y); }
+	template<int n> static v srli(const v x) { return _mm512_srli_epi64(x, n); }
+	template<int n> static v slli(const v x) { return _mm512_slli_epi64(x, n); }
+	static v mul32(const v x, const v y) { return _mm512_mul_epu32(x, y); }
+	static v mullo(const v x, const v y) { return _mm512_mullo_epi64(x, y); }
+};
+#elif defined(__AVX2__)
+#define LCG_SIMD
+struct simd {
+	typedef __m256i v;
+	static constexpr int lanes = 4;
+	static v load(const uint64_t * const p) { return _mm256_loadu_si256((const __m256i *)p); }
+	static void store(uint64_t * const p, const v x) { _mm256_storeu_si256((__m256i *)p, x); }
+	static void store_hi32(uint32_t * const p, const v x) { _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0)))); }
+	static v set1(const uint64_t x) { return _mm256_set1_epi64x(x); }
+	static v add(const v x, const v y) { return _mm256_add_epi64(x, y); }
+	static v and_(const v x, const v y) { return _mm256_and_si256(x, y); }
+	static v or_(const v x, const v y) { return _mm256_or_si256(x, y); }
+	static v andnot(const v x, const v y) { return _mm256_andnot_si256(x, y); }
+	template<int n> static v srli(const v x) { return _mm256_srli_epi64(x, n); }
+	template<int n> static v slli(const v x) { return _mm256_slli_epi64(x, n); }
+	static v mul32(const v x, const v y) { return _mm256_mul_epu32(x, y); }
+	static v mullo(const v x, const v y) { return add(mul32(x, y), slli<32>(add(mul32(srli<32>(x), y), mul32(x, srli<32>(y))))); }
+};
+#endif
+
+#ifdef LCG_SIMD
+// Sets lo and hi to the 128-bit products of the lanes of x by y; y1 contains the upper halves of the lanes of y.
+static inline void mul_full(const simd::v x, const simd::v y, const simd::v y1, simd::v &lo, simd::v &hi) {
+	typedef simd V;
+	const V::v x1 = V::srli<32>(x), mask = V::set1(0xFFFFFFFF);
+	const V::v p00 = V::mul32(x, y), p01 = V::mul32(x, y1), p10 = V::mul32(x1, y), p11 = V::mul32(x1, y1);
+	const V::v mid = V::add(V::add(V::srli<32>(p00), V::and_(p01, mask)), V::and_(p10, mask));
+	hi = V::add(V::add(p11, V::srli<32>(p01)), V::add(V::srli<32>(p10), V::srli<32>(mid)));
+	lo = V::add(p00, V::slli<32>(V::add(p01, p10)));
+}
+
+// Returns the carry of x + y, given s = x + y.
+static inline simd::v carry(const simd::v x, const simd::v y, const simd::v s) {
+	typedef simd V;
+	return V::srli<63>(V::or_(V::and_(x, y), V::andnot(s, V::or_(x, y))));
+}
+#endif
+
+} // namespace detail
+
+/* N independent streams of the engine E (N > 0) generated in lockstep. Output
+   can be interleaved (fill(), where the i-th value comes from stream i % N)
+   or de-interleaved (fill_streams(), where each stream fills a contiguous
+   segment). The SIMD kernels are used when N is a multiple of the number of
+   64-bit lanes of a vector (4 for AVX2, 8 for AVX-512). */
+template<class E, int N> class multi_engine {
+public:
+	typedef typename E::state_type state_type;
+	typedef typename E::result_type result_type;
+	static constexpr int streams = N;
+	static_assert(N > 0, "At least one stream is necessary");
+
+	/* Streams have the given seed and increments increment, increment + 2,
+	   increment + 4, ... For MCGs, which have no increment, streams have
+	   seeds seed, seed + 2, seed + 4, ... instead: they are on the same cycle,
+	   but at unspecified distances, so the next constructor should be
+	   preferred. */
+	explicit multi_engine(const state_type seed = 1, const state_type increment = 1) {
+		for (int j = 0; j < N; j++) {
+			const E e(E::mcg ? seed + 2 * j : seed, increment + 2 * j);
+			x[j] = e.state();
+			c[j] = e.increment();
+		}
+	}
+
+	// Stream j starts from e advanced by j * offset steps, so streams are disjoint for offset * N outputs.
+	multi_engine(E e, const __uint128_t offset) {
+		for (int j = 0; j < N; j++) {
+			x[j] = e.state();
+			c[j] = e.increment();
+			e.jump(offset);
+		}
+	}
+
+	static constexpr result_type min() { return E::min(); }
+	static constexpr result_type max() { return E::max(); }
+
+	// Returns an engine in the current state of stream j.
+	E stream(const int j) const { return E(x[j], c[j]); }
+
+	// Fills [p..p + n) with interleaved outputs; if n is not a multiple of N, only the first n % N streams advance to fill the tail.
+	void fill(result_type * const p, const size_t n) {
+		rounds(p, n / N);
+		for (size_t j = 0, t = n / N * N; t < n; j++, t++) {
+			x[j] = E::step(x[j], c[j]);
+			p[t] = E::output(x[j]);
+		}
+	}
+
+	template<typename R> void fill(R &&r) { fill(std::data(r), std::size(r)); }
+
+	// Fills [p + j * n..p + (j + 1) * n) with the next n outputs of stream j.
+	void fill_streams(result_type * const p, const size_t n) {
+		const size_t block = 64;
+		result_type buffer[block * N];
+		for (size_t done = 0; done < n; done += block) {
+			const size_t r = std::min(block, n - done);
+			rounds(buffer, r);
+			for (int j = 0; j < N; j++)
+				for (size_t i = 0; i < r; i++) p[j * n + done + i] = buffer[i * N + j];
+		}
+	}
+
+private:
+	state_type x[N], c[N];
+
+	// Advances all streams k times, storing interleaved outputs in [p..p + k * N).
+	void rounds(result_type * const p, const size_t k) {
+#ifdef LCG_SIMD
+		if constexpr ((E::state_bits == 64 || E::state_bits == 128) && N % detail::simd::lanes == 0) {
+			simd_rounds(p, k);
+			return;
+		}
+#endif
+		// Local copies help the compiler keep the states in registers
+		state_type s[N], t[N];
+		for (int j = 0; j < N; j++) {
+			s[j] = x[j];
+			t[j] = c[j];
+		}
+		for (size_t i = 0; i < k; i++)
+			for (int j = 0; j < N; j++) {
+				s[j] = E::step(s[j], t[j]);
+				p[i * N + j] = E::output(s[j]);
+			}
+		for (int j = 0; j < N; j++) x[j] = s[j];
+	}
+
+#ifdef LCG_SIMD
+	void simd_rounds(result_type * const p, const size_t k) {
+		typedef detail::simd V;
+		constexpr int W = V::lanes, G = N / W;
+		uint64_t lo[N], hi[N], clo[N], chi[N];
+		for (int j = 0; j < N; j++) {
+			lo[j] = x[j];
+			hi[j] = (__uint128_t)x[j] >> 64;
+			clo[j] = c[j];
+			chi[j] = (__uint128_t)c[j] >> 64;
+		}
+		V::v vlo[G], vhi[G], vclo[G], vchi[G];
+		for (int g = 0; g < G; g++) {
+			vlo[g] = V::load(lo + g * W);
+			vhi[g] = V::load(hi + g * W);
+			vclo[g] = V::load(clo + g * W);
+			vchi[g] = V::load(chi + g * W);
+		}
+
+		constexpr uint64_t a_lo = (uint64_t)E::multiplier, a_hi = (uint64_t)(E::multiplier >> 64);
+		const V::v alo = V::set1(a_lo), alo1 = V::set1(a_lo >> 32), ahi = V::set1(a_hi);
+
+		for (size_t i = 0; i < k; i++)
+			for (int g = 0; g < G; g++) {
+				if constexpr (E::state_bits == 64) {
+					vlo[g] = V::mullo(vlo[g], alo);
+					if constexpr (! E::mcg) vlo[g] = V::add(vlo[g], vclo[g]);
+					V::store_hi32((uint32_t *)p + i * N + g * W, vlo[g]);
+				}
+				else {
+					V::v l, h;
+					detail::mul_full(vlo[g], alo, alo1, l, h);
+					h = V::add(h, V::mullo(vhi[g], alo));
+					// The upper part of the multiplier contributes only to the upper half
+					if constexpr (a_hi == 1) h = V::add(h, vlo[g]);
+					else if constexpr (a_hi != 0) h = V::add(h, V::mullo(vlo[g], ahi));
+					if constexpr (! E::mcg) {
+						const V::v s = V::add(l, vclo[g]);
+						h = V::add(V::add(h, vchi[g]), detail::carry(l, vclo[g], s));
+						l = s;
+					}
+					vlo[g] = l;
+					vhi[g] = h;
+					V::store((uint64_t *)p + i * N + g * W, h);
+				}
+			}
+
+		for (int g = 0; g < G; g++) {
+			V::store(lo + g * W, vlo[g]);
+			V::store(hi + g * W, vhi[g]);
+		}
+		for (int j = 0; j < N; j++) x[j] = E::state_bits == 128 ? (state_type)((__uint128_t)hi[j] << 64 | lo[j]) : (state_type)lo[j];
+	}
+#endif
+};
+
+// The generators of the tables
+typedef congruential_engine<32, 32> lcg32;
+typedef congruential_engine<64, 64> lcg64;
+typedef congruential_engine<128, 65> lcg128;
+typedef congruential_engine<128, 64, true> mcg128;
+
+} // namespace lcg
+
+#endif
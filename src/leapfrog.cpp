@@ -0,0 +1,131 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Prints approximated figures of merit of the generators obtained by
+   leapfrog splitting of a congruential generator (see leapfrog_engine in
+   lcg.hpp). Splitting with stride k yields generators with multiplier a^k,
+   and the lattice structure of their outputs is that of the original
+   generator at lag k (Entacher's characterization of lagged lattices, see
+   spectral.cpp), so their quality is measured by the lagged spectral test
+   computed by spect. Block splitting (see jump() in lcg.hpp) does not
+   change the multiplier, and thus it does not need this check. */
+
+#include <iostream>
+#include <getopt.h>
+#include <unistd.h>
+#include <NTL/LLL.h>
+
+using namespace NTL;
+using namespace std;
+
+#include "common.cpp"
+#include "lll.cpp"
+#include "spectral.cpp"
+#include "lcg.hpp"
+
+int main(int argc, char *argv[]) {
+	bool fixed = false, fp = false, mcg = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+fFm")) != -1) {
+		switch (opt) {
+		case 'f':
+			fixed = true;
+			break;
+		case 'F':
+			fp = true;
+			break;
+		case 'm':
+			mcg = true;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	// A generator from the table of lcg.hpp, in the form TYPE-STATE-BITS
+	const lcg::multiplier_entry *gen = NULL;
+	if (argc >= 3)
+		for (const auto &m : lcg::multipliers)
+			if (string(argv[2]) == string(m.mcg ? "MCG-" : "LCG-") + to_string(m.state_bits) + "-" + to_string(m.mult_bits)) gen = &m;
+
+	if (argc < (gen != NULL ? 4 : 5)) {
+		cerr << "USAGE: " << argv[0] << " [-f] [-F] MAXDIM TYPE-STATE-BITS STRIDE..." << endl;
+		cerr << "       " << argv[0] << " [-f] [-F] [-m] MAXDIM MULTIPLIER MODULUS STRIDE..." << endl << endl;
+		cerr << "Prints, for each given stride k, the figures of merit up to the" << endl;
+		cerr << "specified maximum dimension of the generators obtained by leapfrog" << endl;
+		cerr << "splitting into k streams, each returning every k-th output, of a" << endl;
+		cerr << "generator of lcg.hpp (e.g., LCG-128-65), or of a full-period" << endl;
+		cerr << "congruential generator with the given multiplier and modulus" << endl;
+		cerr << "(with -m, of an MCG with power-of-two modulus). Output is in the" << endl;
+		cerr << "format of spect, with the stride in the lag column, as these are" << endl;
+		cerr << "the figures of merit of the generator at lag k. A stride of one" << endl;
+		cerr << "gives the figures of merit of the generator itself." << endl;
+		cerr << "With -f, lattices are reduced using fixed-width arithmetic when the" << endl;
+		cerr << "modulus is at most 2^128, falling back to NTL in case of failure." << endl;
+		cerr << "With -F, lattices are reduced using NTL's floating-point LLL, with" << endl;
+		cerr << "exact verification, as in spect." << endl;
+		exit(1);
+	}
+
+	const int max_dim = atoi(argv[1]);
+
+	if (max_dim > dim_max) {
+		cerr << "Maximum possible number of dimensions: " << dim_max << endl;
+		exit(1);
+	}
+
+	if (max_dim < 2) {
+		cerr << "Minimum possible number of dimensions: 2" << endl;
+		exit(1);
+	}
+
+	ZZ a, mod;
+	if (gen != NULL) {
+		a = conv<ZZ>((uint128_t)gen->hi << 64 | gen->lo);
+		mod = conv<ZZ>(1) << gen->state_bits;
+		mcg = gen->mcg;
+	}
+	else {
+		a = strtoZZ(argv[2]);
+		mod = strtoZZ(argv[3]);
+	}
+
+	if (mcg && (mod & (mod - 1)) != 0) {
+		cerr << "The modulus must be a power of two" << endl;
+		exit(1);
+	}
+
+	if (a >= mod) {
+		cerr << "The multiplier must be smaller than the modulus: " << a << endl;
+		exit(1);
+	}
+
+	for (int i = gen != NULL ? 3 : 4; i < argc; i++) {
+		const int stride = atoi(argv[i]);
+		if (stride < 1) {
+			cerr << "The stride must be strictly positive" << endl;
+			exit(1);
+		}
+
+		const spectral_test test(mod, stride, mcg);
+		spectral_eval eval(test, fixed, false, false, fp);
+		// The same output as spect STRIDE MAXDIM MULTIPLIER MODULUS
+		double scores[dim_max + 1];
+		spect_scores(eval, a, max_dim, scores);
+		fputs(spect_line(a, stride, max_dim, scores).c_str(), stdout);
+		fflush(stdout);
+
+		if (eval.fallbacks != 0) cerr << reduction_name(eval.fixed, fp) << " reduction failed " << eval.fallbacks << " times for stride " << stride << ": used NTL" << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,369 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Fixed-width LLL reduction of the dual lattice for moduli up to 2^128.
+
+   The basis is kept exactly in a signed fixed-width integer type (int64_t
+   for moduli up to 2^32, __int128 for moduli up to 2^64, and the int256 type
+   below for moduli up to 2^128), whereas the Gram-Schmidt orthogonalization
+   is computed in long double, following Schnorr and Euchner's floating-point
+   LLL. Inner products suffering from cancellation (i.e., smaller than 2^-32
+   times the product of the norms) are recomputed exactly using wrapping
+   arithmetic, which is correct as long as the true value fits the type: as
+   entries are bounded by fixed_traits::limit, the product of the norms is
+   at most dim_max * limit^2, so limit is chosen so that 2^-32 * dim_max *
+   limit^2 fits the type, and reduction fails when an entry reaches it.
+
+   Whenever something goes wrong (entries too large, loss of precision, too
+   many iterations) reduction fails, and the caller is expected to fall back
+   to NTL. Must be included after common.cpp. */
+
+#include <cmath>
+
+// A 256-bit two's complement integer providing just what is needed by fixed_lll.
+struct int256 {
+	uint64_t w[4]; // Little endian
+
+	int256() {}
+
+	int256(int64_t x) {
+		w[0] = x;
+		w[1] = w[2] = w[3] = x < 0 ? ~UINT64_C(0) : 0;
+	}
+
+	int256(uint128_t x) {
+		w[0] = x;
+		w[1] = x >> 64;
+		w[2] = w[3] = 0;
+	}
+
+	bool negative() const { return w[3] >> 63; }
+};
+
+inline int256 operator+(const int256 &a, const int256 &b) {
+	int256 r;
+	uint64_t carry = 0;
+	for(int i = 0; i < 4; i++) {
+		const uint128_t t = (uint128_t)a.w[i] + b.w[i] + carry;
+		r.w[i] = t;
+		carry = t >> 64;
+	}
+	return r;
+}
+
+inline int256 operator-(const int256 &a) {
+	int256 r;
+	uint64_t carry = 1;
+	for(int i = 0; i < 4; i++) {
+		const uint128_t t = (uint128_t)~a.w[i] + carry;
+		r.w[i] = t;
+		carry = t >> 64;
+	}
+	return r;
+}
+
+inline int256 operator-(const int256 &a, const int256 &b) {
+	return a + -b;
+}
+
+// Lower 256 bits of the product (which are the same for signed and unsigned operands).
+inline int256 operator*(const int256 &a, const int256 &b) {
+	int256 r(INT64_C(0));
+	for(int i = 0; i < 4; i++) {
+		uint64_t carry = 0;
+		for(int j = 0; i + j < 4; j++) {
+			const uint128_t t = (uint128_t)a.w[i] * b.w[j] + r.w[i + j] + carry;
+			r.w[i + j] = t;
+			carry = t >> 64;
+		}
+	}
+	return r;
+}
+
+inline int256 operator<<(const int256 &a, int s) {
+	int256 r(INT64_C(0));
+	const int q = s / 64, o = s % 64;
+	for(int i = 3; i >= q; i--) {
+		r.w[i] = a.w[i - q] << o;
+		if (o != 0 && i - q - 1 >= 0) r.w[i] |= a.w[i - q - 1] >> (64 - o);
+	}
+	return r;
+}
+
+/* Operations needed by fixed_lll, for each supported type. Arithmetic used to
+   compute exact inner products is wrapping (i.e., unsigned). */
+
+template <typename T> struct fixed_traits;
+
+template <> struct fixed_traits<int64_t> {
+	typedef uint64_t wrap_t;
+	// Bound on the absolute value of the entries of the basis
+	static constexpr long double limit = 0x1p45L; // 2^-32 * 24 * 2^90 < 2^63
+	static long double to_ld(int64_t x) { return x; }
+	static int64_t from_ld(long double x) { return (int64_t)x; }
+	static int64_t from_u128(uint128_t x) { return (int64_t)x; }
+};
+
+template <> struct fixed_traits<__int128> {
+	typedef uint128_t wrap_t;
+	static constexpr long double limit = 0x1p77L; // 2^-32 * 24 * 2^154 < 2^127
+	static long double to_ld(__int128 x) { return x < 0 ? -(long double)(uint128_t)-x : (long double)(uint128_t)x; }
+	static __int128 from_ld(long double x) { return x < 0 ? -(__int128)(uint128_t)-x : (__int128)(uint128_t)x; }
+	static __int128 from_u128(uint128_t x) { return (__int128)x; }
+};
+
+template <> struct fixed_traits<int256> {
+	typedef int256 wrap_t;
+	static constexpr long double limit = 0x1p141L; // 2^-32 * 24 * 2^282 < 2^255
+
+	static long double to_ld(const int256 &x) {
+		if (x.negative()) return -to_ld(-x);
+		long double r = 0;
+		for(int i = 4; i-- != 0;) r = ldexpl(r, 64) + x.w[i];
+		return r;
+	}
+
+	static int256 from_ld(long double x) {
+		if (x < 0) return -from_ld(-x);
+		if (x < 0x1p64L) return int256((uint128_t)(uint64_t)x);
+		int e;
+		// x = m * 2^(e - 64), with m a 64-bit integer
+		const uint64_t m = ldexpl(frexpl(x, &e), 64);
+		return int256((uint128_t)m) << (e - 64);
+	}
+
+	static int256 from_u128(uint128_t x) { return int256(x); }
+};
+
+template <typename T> struct fixed_lll {
+	typedef fixed_traits<T> traits;
+	typedef typename traits::wrap_t wrap_t;
+
+	// Maximum number of size reductions and swaps before giving up
+	static constexpr int max_steps = 100000;
+
+	T b[dim_max][dim_max]; // The basis (rows)
+	long double bf[dim_max][dim_max]; // Floating-point approximation of the basis
+	long double n2[dim_max]; // Squared norms of the rows of bf
+	long double mu[dim_max][dim_max], c[dim_max]; // Gram-Schmidt coefficients and squared norms
+	int d;
+
+	void approx(int k) {
+		n2[k] = 0;
+		for (int j = 0; j < d; j++) {
+			bf[k][j] = traits::to_ld(b[k][j]);
+			n2[k] += bf[k][j] * bf[k][j];
+		}
+	}
+
+	long double dot(int k, int i) {
+		long double s = 0;
+		for (int j = 0; j < d; j++) s += bf[k][j] * bf[i][j];
+		if (fabsl(s) >= 0x1p-32L * sqrtl(n2[k] * n2[i])) return s;
+		// Cancellation: exact computation using wrapping arithmetic
+		wrap_t e = wrap_t(INT64_C(0));
+		for (int j = 0; j < d; j++) e = e + (wrap_t)b[k][j] * (wrap_t)b[i][j];
+		return traits::to_ld((T)e);
+	}
+
+	/* Computes mu[k][0..k) and c[k] from the rows before k, which must be up to
+	   date. Returns false if c[k] is below the precision of the computation. In
+	   the first phases of the reduction of the dual lattice this is the norm,
+	   as the basis is extremely skewed: in that case, c[k] is set to the
+	   minimum value we can resolve, which is enough to guide the reduction
+	   towards shorter vectors. */
+	bool gram_schmidt(int k) {
+		long double r[dim_max];
+		c[k] = n2[k];
+		for (int j = 0; j < k; j++) {
+			r[j] = dot(k, j);
+			for (int i = 0; i < j; i++) r[j] -= mu[j][i] * r[i];
+			mu[k][j] = r[j] / c[j];
+			c[k] -= mu[k][j] * r[j];
+		}
+		if (c[k] >= n2[k] * 0x1p-40L) return true;
+		c[k] = n2[k] * 0x1p-56L;
+		return false;
+	}
+
+	/* Sets up the dual lattice (see Knuth TAoCP Vol. 2, 3.3.4/B*) in dimension d
+	   for modulus mod given the residues of the powers of the multiplier. */
+	void dual(const T &mod, const uint128_t pow[], int d) {
+		this->d = d;
+		for (int i = 0; i < d; i++)
+			for (int j = 0; j < d; j++) b[i][j] = T(INT64_C(0));
+		b[0][0] = mod;
+		for (int i = 1; i < d; i++) {
+			b[i][i] = T(INT64_C(1));
+			b[i][0] = -traits::from_u128(pow[i]);
+		}
+		for (int i = 0; i < d; i++) approx(i);
+	}
+
+	/* Extends an LLL-reduced basis of the dual lattice in dimension d - 1 to a
+	   basis in dimension d by adding a zero coordinate to all vectors and the
+	   vector (-a^(d - 1), 0, ..., 0, 1). */
+	void extend(const uint128_t pow[], int d) {
+		this->d = d;
+		for (int i = 0; i < d - 1; i++) {
+			b[i][d - 1] = T(INT64_C(0));
+			bf[i][d - 1] = 0;
+		}
+		for (int j = 0; j < d; j++) b[d - 1][j] = T(INT64_C(0));
+		b[d - 1][0] = -traits::from_u128(pow[d - 1]);
+		b[d - 1][d - 1] = T(INT64_C(1));
+		approx(d - 1);
+	}
+
+	/* LLL reduction with delta = 0.999999999; returns false on failure. The
+	   rows before start must be already reduced, with Gram-Schmidt data up
+	   to date. */
+	bool reduce(int start = 1) {
+		const long double delta = 0.999999999L;
+		int steps = 0;
+
+		c[0] = n2[0];
+
+		for (int k = start; k < d;) {
+			// Size reduction
+			for(;;) {
+				gram_schmidt(k);
+
+				bool reduced = false;
+				for (int j = k; j-- != 0;) {
+					if (fabsl(mu[k][j]) <= 0.51L) continue;
+					const long double q = roundl(mu[k][j]);
+					long double max = 0;
+					for (int i = 0; i < d; i++) max = fmaxl(max, fabsl(bf[j][i]));
+					if (fabsl(q) * max >= traits::limit) return false;
+					const T tq = traits::from_ld(q);
+					for (int i = 0; i < d; i++) b[k][i] = b[k][i] - tq * b[j][i];
+					for (int i = 0; i < j; i++) mu[k][i] -= q * mu[j][i];
+					mu[k][j] -= q;
+					reduced = true;
+				}
+
+				if (! reduced) break;
+				if (++steps > max_steps) return false;
+				approx(k);
+				for (int i = 0; i < d; i++) if (fabsl(bf[k][i]) >= traits::limit) return false;
+			}
+
+			// Lovász condition
+			if (c[k] < (delta - mu[k][k - 1] * mu[k][k - 1]) * c[k - 1]) {
+				if (++steps > max_steps) return false;
+				for (int i = 0; i < d; i++) {
+					swap(b[k][i], b[k - 1][i]);
+					swap(bf[k][i], bf[k - 1][i]);
+				}
+				swap(n2[k], n2[k - 1]);
+				if (k == 1) c[0] = n2[0];
+				else k--;
+			}
+			else k++;
+		}
+
+		// Verification of the result, which must not depend on low-precision values
+		for (int k = 1; k < d; k++) {
+			if (! gram_schmidt(k)) return false;
+			for (int j = 0; j < k; j++) if (fabsl(mu[k][j]) > 0.51L) return false;
+			if (c[k] < (delta - 0x1p-32L - mu[k][k - 1] * mu[k][k - 1]) * c[k - 1]) return false;
+		}
+
+		return true;
+	}
+
+	// Returns the squared length of the shortest vector of the basis.
+	double min2() {
+		long double m = numeric_limits<long double>::infinity();
+		for (int i = 0; i < d; i++) m = fminl(m, n2[i]);
+		return m;
+	}
+};
+
+/* Reduces dual lattices modulo a fixed modulus not larger than 2^128 using the
+   narrowest fixed-width type. */
+struct fixed_reducer {
+	int width; // 64, 128 or 256
+	bool pow2;
+	uint128_t mask; // mod - 1
+	ZZ mod, x, p; // The modulus, and scratch space for multiplier()
+	uint128_t pow[dim_max]; // Residues of the powers of the multiplier
+	int last_d; // Dimension of the last successful reduction for the current multiplier, or zero
+	int64_t m64;
+	__int128 m128;
+	int256 m256;
+	fixed_lll<int64_t> l64;
+	fixed_lll<__int128> l128;
+	fixed_lll<int256> l256;
+
+	fixed_reducer(const ZZ &mod) : mod(mod), last_d(0) {
+		const long bits = NumBits(mod - 1);
+		width = bits <= 32 ? 64 : bits <= 64 ? 128 : bits <= 128 ? 256 : 0;
+		pow2 = (mod & (mod - 1)) == 0;
+		mask = width != 0 ? conv<uint128_t>(mod - 1) : 0;
+		m64 = m128 = mask + 1;
+		// 2^128 does not fit in a uint128_t
+		m256 = int256(mask) + int256(INT64_C(1));
+	}
+
+	// Whether the modulus is small enough for fixed-width reduction.
+	bool usable() const { return width != 0; }
+
+	/* Computes the residues of the powers of a^lag (a not necessarily reduced)
+	   without allocating memory. For power-of-two moduli, arithmetic is
+	   entirely in 128-bit integers. The modulus must divide the modulus of
+	   the generator, so that a^lag can be computed directly modulo mod. */
+	void multiplier(const ZZ &a, const int lag = 1) {
+		last_d = 0;
+		pow[0] = 1;
+		if (pow2) {
+			uint128_t x = conv<uint128_t>(a) & mask;
+			if (lag != 1) {
+				uint128_t y = 1;
+				for (int e = lag; e != 0; e >>= 1, x = x * x & mask) if (e & 1) y = y * x & mask;
+				x = y;
+			}
+			for (int i = 1; i < dim_max; i++) pow[i] = pow[i - 1] * x & mask;
+		}
+		else {
+			rem(x, a, mod);
+			if (lag != 1) PowerMod(x, x, lag, mod);
+			set(p);
+			for (int i = 1; i < dim_max; i++) {
+				MulMod(p, p, x, mod);
+				pow[i] = conv<uint128_t>(p);
+			}
+		}
+	}
+
+	/* Stores in min2 the squared length of the shortest vector of an LLL-reduced
+	   basis of the dual lattice in dimension d; returns false on failure. If
+	   incremental is true and the previous call for the same multiplier was
+	   successful in dimension d - 1, the previous reduced basis is extended
+	   instead of starting from scratch. */
+	bool min2(int d, double &min2, bool incremental = false) {
+		const bool extend = incremental && last_d == d - 1;
+		last_d = 0;
+		switch(width) {
+		case 64: return reduce(l64, m64, d, min2, extend);
+		case 128: return reduce(l128, m128, d, min2, extend);
+		case 256: return reduce(l256, m256, d, min2, extend);
+		}
+		return false;
+	}
+
+	template <typename T> bool reduce(fixed_lll<T> &l, const T &m, int d, double &min2, bool extend) {
+		if (extend) l.extend(pow, d);
+		else l.dual(m, pow, d);
+		if (! l.reduce(extend ? d - 1 : 1)) return false;
+		min2 = l.min2();
+		last_d = d;
+		return true;
+	}
+};
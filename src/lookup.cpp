@@ -0,0 +1,98 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Queries a multiplier database built by mkdb. */
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+#include "multdb.cpp"
+
+int main(int argc, char *argv[]) {
+	bool range = false;
+	int64_t top = -1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+rt:")) != -1) {
+		switch (opt) {
+		case 'r':
+			range = true;
+			break;
+		case 't':
+			top = strtoll(optarg, NULL, 0);
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc < 2 || (range && argc != 4) || (top >= 0 && argc != 2)) {
+		cerr << "USAGE: " << argv[0] << " DB [MULTIPLIER...]" << endl;
+		cerr << "       " << argv[0] << " -r DB FROM TO" << endl;
+		cerr << "       " << argv[0] << " -t N DB" << endl << endl;
+		cerr << "Queries a database built by mkdb, printing rows in the format of the" << endl;
+		cerr << "original text database. Prints the rows of the given multipliers (in" << endl;
+		cerr << "decimal or hexadecimal), or of the multipliers read from standard" << endl;
+		cerr << "input, one per line, if none is given; missing multipliers are" << endl;
+		cerr << "reported on standard error, and the exit code is 2 if any is missing." << endl;
+		cerr << "With -r, prints the rows of the multipliers between FROM and TO" << endl;
+		cerr << "(inclusive). With -t, prints the N rows with the largest harmonic" << endl;
+		cerr << "score (at most as many as specified when building the database)." << endl;
+		exit(1);
+	}
+
+	const multdb db(argv[1]);
+
+	auto parse = [](const char * const s) {
+		uint128_t a;
+		if (! parse_u128(s, a)) {
+			cerr << "Invalid multiplier: " << s << endl;
+			exit(1);
+		}
+		return a;
+	};
+
+	if (top >= 0) {
+		if ((uint64_t)top > db.h.top_rows) cerr << "Only the top " << db.h.top_rows << " rows are available" << endl;
+		for (uint64_t i = 0; i < min((uint64_t)top, db.h.top_rows); i++) db.print(stdout, db.top_row(i));
+		return 0;
+	}
+
+	if (range) {
+		db.range(parse(argv[2]), parse(argv[3]), [&](const multdb_row &r) { db.print(stdout, r); });
+		return 0;
+	}
+
+	bool missing = false;
+	multdb_row r;
+	auto query = [&](const char * const s) {
+		if (db.find(parse(s), r)) db.print(stdout, r);
+		else {
+			cerr << "Not found: " << s << endl;
+			missing = true;
+		}
+	};
+
+	if (argc > 2) for (int i = 2; i < argc; i++) query(argv[i]);
+	else {
+		char *line = NULL;
+		size_t size = 0;
+		while (getline(&line, &size, stdin) != -1) {
+			line[strcspn(line, "\t \n")] = 0;
+			if (*line) query(line);
+		}
+		free(line);
+	}
+
+	return missing ? 2 : 0;
+}
@@ -0,0 +1,247 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Builds a sorted, indexed multiplier database (see multdb.cpp) from a text
+   database. Rows are sorted in memory in chunks, which are written to
+   temporary files and then merged, so databases larger than the available
+   memory can be sorted. */
+
+#include <iostream>
+#include <algorithm>
+#include <queue>
+#include <unistd.h>
+
+using namespace std;
+
+#include "textdb.cpp"
+#include "multdb.cpp"
+
+int main(int argc, char *argv[]) {
+	int before = 2, opt;
+	uint64_t block_rows = 128, top_rows = 10000, memory = 1024;
+	const char *tmp_dir = ".";
+
+	while ((opt = getopt(argc, argv, "+ab:t:m:T:")) != -1) {
+		switch (opt) {
+		case 'a':
+			before = 3;
+			break;
+		case 'b':
+			block_rows = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			top_rows = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			memory = strtoull(optarg, NULL, 0);
+			break;
+		case 'T':
+			tmp_dir = optarg;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != 3 || block_rows == 0 || memory == 0) {
+		cerr << "USAGE: " << argv[0] << " [-a] [-b BLOCK] [-t TOP] [-m MEGABYTES] [-T DIR] INPUT OUTPUT" << endl << endl;
+		cerr << "Builds from the text database INPUT, in the format generated by" << endl;
+		cerr << "search (or, with -a, in the aggregate format containing the minimum" << endl;
+		cerr << "lagged score) a database sorted by multiplier, which can be queried" << endl;
+		cerr << "by lookup. Duplicate multipliers are stored once. Rows are stored" << endl;
+		cerr << "in compressed blocks of BLOCK rows (default: 128), and the TOP rows" << endl;
+		cerr << "with largest harmonic score (default: 10000) are listed separately." << endl;
+		cerr << "Rows are sorted in chunks of at most MEGABYTES megabytes (default:" << endl;
+		cerr << "1024), which are stored in temporary files in DIR (default: .)." << endl;
+		exit(1);
+	}
+
+	text_file in(argv[1]);
+	vector<const char *> field;
+	const char *s, *e;
+	int columns = -1;
+
+	// Rows are stored in memory and in temporary files as a multiplier followed by the scores
+	size_t row_size = 0;
+	vector<char> chunk;
+	vector<uint32_t> perm;
+	vector<string> runs;
+
+	auto key = [&](const char * const p) {
+		uint128_t a;
+		memcpy(&a, p, sizeof a);
+		return a;
+	};
+
+	// Sorts the chunk (stably, so the first occurrence of a multiplier comes first) and writes it to a temporary file.
+	auto flush = [&]() {
+		const size_t n = chunk.size() / row_size;
+		if (n == 0) return;
+		perm.resize(n);
+		for (size_t i = 0; i < n; i++) perm[i] = i;
+		stable_sort(perm.begin(), perm.end(), [&](uint32_t x, uint32_t y) { return key(&chunk[x * row_size]) < key(&chunk[y * row_size]); });
+		const string name = string(tmp_dir) + "/" + string(basename(argv[2])) + ".run" + to_string(runs.size());
+		FILE * const f = fopen(name.c_str(), "w");
+		if (f == NULL) {
+			perror(name.c_str());
+			exit(1);
+		}
+		for (uint32_t i : perm) fwrite(&chunk[i * row_size], 1, row_size, f);
+		if (fclose(f) != 0) {
+			perror(name.c_str());
+			exit(1);
+		}
+		runs.push_back(name);
+		chunk.clear();
+	};
+
+	while (in.next(s, e)) {
+		split(s, e, field);
+		if (field.size() == 1 && s == e) continue; // Empty line
+		if (columns == -1) {
+			columns = field.size() - 2;
+			if (columns <= before || columns > multdb_max_columns) in.error("Unrecognized format");
+			row_size = sizeof(uint128_t) + columns * sizeof(uint32_t);
+		}
+		else if ((int)field.size() != columns + 2) in.error("Wrong number of columns");
+
+		const size_t pos = chunk.size();
+		chunk.resize(pos + row_size);
+		uint128_t a = 0;
+		for (const char *p = field[before]; p < field[before + 1] - 1; p++) {
+			if (*p < '0' || *p > '9' || a > (~uint128_t(0) - 9) / 10) in.error("Invalid multiplier");
+			a = a * 10 + (*p - '0');
+		}
+		memcpy(&chunk[pos], &a, sizeof a);
+
+		uint32_t score[multdb_max_columns];
+		for (int c = 0, i = 0; i < (int)field.size(); i++) {
+			if (i == before || i == before + 1) continue; // Decimal and hexadecimal multiplier
+			const int64_t x = parse_score(field[i], i == (int)field.size() - 1 ? e : field[i + 1] - 1);
+			if (x < 0 || x > UINT32_MAX) in.error("Invalid score");
+			score[c++] = x;
+		}
+		memcpy(&chunk[pos + sizeof a], score, columns * sizeof *score);
+
+		if (chunk.size() >= memory << 20) flush();
+	}
+
+	if (columns == -1) {
+		cerr << "Empty input" << endl;
+		exit(1);
+	}
+
+	flush();
+
+	// Merge the runs, removing duplicates, and write the blocks
+	FILE * const out = fopen(argv[2], "w");
+	if (out == NULL) {
+		perror(argv[2]);
+		exit(1);
+	}
+
+	multdb_header h = {};
+	memcpy(h.magic, "MULTDB01", 8);
+	h.before = before;
+	h.columns = columns;
+	h.block_rows = block_rows;
+	fwrite(&h, sizeof h, 1, out);
+
+	vector<FILE *> run(runs.size());
+	vector<vector<char>> head(runs.size(), vector<char>(row_size));
+	// Pairs (multiplier, run) ordered so that the smallest multiplier (from the first run) comes first
+	priority_queue<pair<uint128_t, size_t>, vector<pair<uint128_t, size_t>>, greater<pair<uint128_t, size_t>>> queue;
+	for (size_t i = 0; i < runs.size(); i++) {
+		run[i] = fopen(runs[i].c_str(), "r");
+		if (run[i] == NULL || fread(head[i].data(), 1, row_size, run[i]) != row_size) {
+			perror(runs[i].c_str());
+			exit(1);
+		}
+		queue.emplace(key(head[i].data()), i);
+	}
+
+	vector<multdb_index> index;
+	// Rows with the largest harmonic scores: the worst one (smallest score, then largest multiplier) is on top
+	typedef pair<uint32_t, pair<uint128_t, uint64_t>> top_entry;
+	auto worse = [](const top_entry &x, const top_entry &y) { return x.first > y.first || (x.first == y.first && x.second.first < y.second.first); };
+	priority_queue<top_entry, vector<top_entry>, decltype(worse)> top(worse);
+	const int harm = before - 1;
+	string block;
+	uint128_t prev = 0;
+	uint64_t offset = sizeof h;
+	bool first = true;
+
+	while (! queue.empty()) {
+		const size_t i = queue.top().second;
+		queue.pop();
+		const uint128_t a = key(head[i].data());
+		if (first || a != prev) {
+			if (h.rows % block_rows == 0) {
+				if (! block.empty()) {
+					fwrite(block.data(), 1, block.size(), out);
+					offset += block.size();
+					block.clear();
+				}
+				index.push_back({ a, offset, 0 });
+				prev = a;
+			}
+			uint32_t score[multdb_max_columns];
+			memcpy(score, head[i].data() + sizeof a, columns * sizeof *score);
+			put_varint(block, a - prev);
+			for (int c = 0; c < columns; c++) put_varint(block, score[c]);
+
+			if (top_rows != 0) {
+				top.push({ score[harm], { a, h.rows } });
+				if (top.size() > top_rows) top.pop();
+			}
+
+			prev = a;
+			first = false;
+			h.rows++;
+		}
+
+		if (fread(head[i].data(), 1, row_size, run[i]) == row_size) queue.emplace(key(head[i].data()), i);
+		else {
+			fclose(run[i]);
+			unlink(runs[i].c_str());
+		}
+	}
+
+	fwrite(block.data(), 1, block.size(), out);
+	offset += block.size();
+
+	// Sparse index, aligned to 16 bytes
+	const char zero[16] = {};
+	fwrite(zero, 1, -offset & 15, out);
+	offset += -offset & 15;
+	h.blocks = index.size();
+	h.index_offset = offset;
+	fwrite(index.data(), sizeof(multdb_index), index.size(), out);
+	offset += index.size() * sizeof(multdb_index);
+
+	// Rows by decreasing harmonic score
+	vector<uint64_t> best(top.size());
+	for (size_t i = best.size(); i-- != 0; top.pop()) best[i] = top.top().second.second;
+	h.top_offset = offset;
+	h.top_rows = best.size();
+	fwrite(best.data(), sizeof(uint64_t), best.size(), out);
+
+	fseek(out, 0, SEEK_SET);
+	fwrite(&h, sizeof h, 1, out);
+	if (fclose(out) != 0) {
+		perror(argv[2]);
+		exit(1);
+	}
+
+	cerr << "Rows: " << h.rows << endl;
+	cerr << "Blocks: " << h.blocks << endl;
+	cerr << "Size: " << offset + h.top_rows * sizeof(uint64_t) << " bytes" << endl;
+}
@@ -0,0 +1,223 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Sorted, indexed multiplier databases, built by mkdb and queried by lookup.
+   It does not depend on NTL. Must be included after using namespace std.
+
+   A database contains the rows of a text database (in the format of search,
+   or in the aggregate format with the minimum lagged score) sorted by
+   multiplier, without duplicates. Scores are stored as fixed-point numbers
+   with six decimal places, which is the precision of the text format.
+
+   The file starts with a multdb_header. Rows are grouped in blocks of
+   block_rows rows: in a block, each multiplier is stored as a varint
+   (LEB128) difference with the previous one (the first one with the first
+   multiplier of the block), followed by the scores as varints. The blocks
+   are followed by a sparse index containing, for each block, its first
+   multiplier and its offset, and by the indices of the top_rows rows with
+   the largest harmonic score, in decreasing order (ties are broken by
+   multiplier). Point queries need a binary search on the index and the
+   decoding of a single block, and the file is memory mapped, so they take
+   microseconds without loading the file. */
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef __uint128_t uint128_t;
+
+struct multdb_header {
+	char magic[8]; // "MULTDB01"
+	uint32_t before; // Number of score columns before the multiplier
+	uint32_t columns; // Number of score columns
+	uint32_t block_rows;
+	uint32_t reserved;
+	uint64_t rows, blocks;
+	uint64_t index_offset; // Offset of the sparse index
+	uint64_t top_offset, top_rows; // Offset and size of the rows sorted by harmonic score
+};
+
+// Maximum number of score columns
+const int multdb_max_columns = 32;
+
+// A row: multiplier and scores in millionths
+struct multdb_row {
+	uint128_t a;
+	uint32_t score[multdb_max_columns];
+};
+
+// An entry of the sparse index
+struct multdb_index {
+	uint128_t first;
+	uint64_t offset;
+	uint64_t reserved;
+};
+
+inline void put_varint(string &s, uint128_t x) {
+	while (x >= 0x80) {
+		s += char(x | 0x80);
+		x >>= 7;
+	}
+	s += char(x);
+}
+
+inline uint128_t get_varint(const uint8_t *&p) {
+	uint128_t x = 0;
+	for (int shift = 0; ; shift += 7) {
+		const uint8_t b = *p++;
+		x |= uint128_t(b & 0x7F) << shift;
+		if (b < 0x80) return x;
+	}
+}
+
+// Parses a multiplier in decimal or hexadecimal (0x) form; returns false if it is not valid.
+inline bool parse_u128(const char *s, uint128_t &a) {
+	const int base = s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 16 : 10;
+	if (base == 16) s += 2;
+	if (*s == 0) return false;
+	for (a = 0; *s; s++) {
+		const int d = isdigit(*s) ? *s - '0' : base == 16 && isxdigit(*s) ? tolower(*s) - 'a' + 10 : -1;
+		if (d < 0 || a > (~uint128_t(0) - d) / base) return false;
+		a = a * base + d;
+	}
+	return true;
+}
+
+inline string u128_dec(uint128_t a) {
+	string s;
+	do s += '0' + a % 10; while ((a /= 10) != 0);
+	return string(s.rbegin(), s.rend());
+}
+
+inline string u128_hex(uint128_t a) {
+	string s;
+	do s += "0123456789abcdef"[a % 16]; while ((a /= 16) != 0);
+	return string(s.rbegin(), s.rend());
+}
+
+struct multdb {
+	multdb_header h;
+	const uint8_t *base;
+	size_t size;
+	const multdb_index *index;
+	const uint64_t *top;
+
+	multdb(const char * const file) {
+		const int fd = open(file, O_RDONLY);
+		struct stat st;
+		if (fd == -1 || fstat(fd, &st) == -1) {
+			perror(file);
+			exit(1);
+		}
+		size = st.st_size;
+		if (size < sizeof h) {
+			cerr << "Not a multiplier database: " << file << endl;
+			exit(1);
+		}
+		base = (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED) {
+			perror(file);
+			exit(1);
+		}
+		close(fd);
+		memcpy(&h, base, sizeof h);
+		if (memcmp(h.magic, "MULTDB01", 8) != 0 || h.columns > multdb_max_columns || h.index_offset + h.blocks * sizeof(multdb_index) > size || h.top_offset + h.top_rows * sizeof(uint64_t) > size) {
+			cerr << "Not a multiplier database: " << file << endl;
+			exit(1);
+		}
+		index = (const multdb_index *)(base + h.index_offset);
+		top = (const uint64_t *)(base + h.top_offset);
+	}
+
+	~multdb() { munmap((void *)base, size); }
+
+	// Decodes the rows of block b, calling f(row) until it returns false; returns false if f did.
+	template<typename F> bool scan_block(const uint64_t b, F f) const {
+		const uint8_t *p = base + index[b].offset;
+		const uint64_t n = min<uint64_t>(h.block_rows, h.rows - b * h.block_rows);
+		multdb_row r;
+		r.a = index[b].first;
+		for (uint64_t i = 0; i < n; i++) {
+			r.a += get_varint(p);
+			for (uint32_t c = 0; c < h.columns; c++) r.score[c] = get_varint(p);
+			if (! f(r)) return false;
+		}
+		return true;
+	}
+
+	// Returns the last block whose first multiplier is at most a, or -1.
+	int64_t block_of(const uint128_t a) const {
+		int64_t lo = 0, hi = h.blocks; // The block is in [lo - 1..hi)
+		while (lo < hi) {
+			const int64_t mid = (lo + hi) / 2;
+			if (index[mid].first <= a) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo - 1;
+	}
+
+	// Point query: returns true and fills r if a is in the database.
+	bool find(const uint128_t a, multdb_row &r) const {
+		const int64_t b = block_of(a);
+		if (b < 0) return false;
+		bool found = false;
+		scan_block(b, [&](const multdb_row &x) {
+			if (x.a >= a) {
+				found = x.a == a;
+				if (found) r = x;
+				return false;
+			}
+			return true;
+		});
+		return found;
+	}
+
+	// Range scan: calls f(row) for the rows with multipliers in [from..to], in order.
+	template<typename F> void range(const uint128_t from, const uint128_t to, F f) const {
+		for (uint64_t b = max<int64_t>(0, block_of(from)); b < h.blocks && index[b].first <= to; b++)
+			if (! scan_block(b, [&](const multdb_row &x) {
+				if (x.a < from) return true;
+				if (x.a > to) return false;
+				f(x);
+				return true;
+			})) return;
+	}
+
+	// Returns the row with the given index.
+	multdb_row row(const uint64_t i) const {
+		multdb_row r;
+		uint64_t j = i / h.block_rows * h.block_rows;
+		scan_block(i / h.block_rows, [&](const multdb_row &x) {
+			r = x;
+			return j++ != i;
+		});
+		return r;
+	}
+
+	// Returns the i-th row by decreasing harmonic score (i < h.top_rows).
+	multdb_row top_row(const uint64_t i) const { return row(top[i]); }
+
+	// Prints a row in the original text format.
+	void print(FILE * const f, const multdb_row &r) const {
+		string s;
+		char buf[32];
+		for (uint32_t c = 0; c < h.columns; c++) {
+			if (c == h.before) s += u128_dec(r.a) + "\t0x" + u128_hex(r.a) + "\t";
+			snprintf(buf, sizeof buf, "%u.%06u", r.score[c] / 1000000, r.score[c] % 1000000);
+			s += buf;
+			s += c == h.columns - 1 ? '\n' : '\t';
+		}
+		fputs(s.c_str(), f);
+	}
+};
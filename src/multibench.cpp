@@ -0,0 +1,148 @@
+/*  Written in 2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Throughput benchmark for bulk generation with the engines of lcg.hpp,
+   using the multipliers of benchmark.c. For each multiplier size, a buffer
+   is filled repeatedly by a single engine (whose speed is bounded by the
+   latency of multiplication, like in benchmark.c) and by multi_engine with
+   4, 8 and 16 streams, using the SIMD kernels if compiled with AVX2 or
+   AVX-512 enabled (e.g., with -march=native). Throughput is measured in
+   GB/s of output. */
+
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "lcg.hpp"
+
+using namespace lcg;
+
+static uint64_t get_user_time(void) {
+	struct rusage rusage;
+	getrusage(0, &rusage);
+	return rusage.ru_utime.tv_sec * 1000000000ULL + rusage.ru_utime.tv_usec * 1000ULL;
+}
+
+// Size of the output buffer, in values
+static size_t buffer_size = 4096;
+static uint64_t iterations;
+static bool deinterleaved;
+
+template<class G> static double run(G &g) {
+	vector<typename G::result_type> buffer(buffer_size);
+	uint64_t sink = 0;
+	const uint64_t start_time = get_user_time();
+	for (uint64_t done = 0; done < iterations; done += buffer_size) {
+		if constexpr (G::streams > 1) {
+			if (deinterleaved) g.fill_streams(buffer.data(), buffer_size / G::streams);
+			else g.fill(buffer);
+		}
+		else g.fill(buffer);
+		sink += buffer[done % buffer_size];
+	}
+	const uint64_t time_delta = get_user_time() - start_time;
+	const volatile uint64_t unused = sink;
+	(void)unused;
+	return (iterations / buffer_size * buffer_size * sizeof(typename G::result_type)) / (double)time_delta;
+}
+
+// A single engine, as a one-stream generator
+template<class E> struct single : E {
+	static constexpr int streams = 1;
+	using E::E;
+};
+
+template<int STATE, int MSIZE, bool MCG, __uint128_t MULTIPLIER> static void bench(const char * const name) {
+	typedef congruential_engine<STATE, MSIZE, MCG, MULTIPLIER> E;
+	single<E> g1(iterations);
+	multi_engine<E, 4> g4(iterations);
+	multi_engine<E, 8> g8(iterations);
+	multi_engine<E, 16> g16(iterations);
+	printf("%s", name);
+	printf("\t%.03f", run(g1));
+	printf("\t%.03f", run(g4));
+	printf("\t%.03f", run(g8));
+	printf("\t%.03f\n", run(g16));
+}
+
+#define M(HI) (((__uint128_t)(HI) << 64) + 0xdeadf00ddeadf00d)
+
+template<bool MCG> static void bench_all() {
+	bench<32, 32, MCG, 0xdeadf00d>("32-32");
+	bench<64, 64, MCG, 0xdeadf00ddeadf00d>("64-64");
+	bench<128, 64, MCG, M(0)>("128-64");
+	bench<128, 65, MCG, M(1)>("128-65");
+	bench<128, 66, MCG, M(2)>("128-66_2");
+	bench<128, 66, MCG, M(3)>("128-66_3");
+	bench<128, 67, MCG, M(4)>("128-67_4");
+	bench<128, 67, MCG, M(5)>("128-67_5");
+	bench<128, 67, MCG, M(6)>("128-67_6");
+	bench<128, 67, MCG, M(7)>("128-67_7");
+	bench<128, 68, MCG, M(0xc)>("128-68_0xc");
+	bench<128, 69, MCG, M(0x18)>("128-69_0x18");
+	bench<128, 72, MCG, M(0xEF)>("128-72");
+	bench<128, 80, MCG, M(0xBEEF)>("128-80");
+	bench<128, 81, MCG, M(0x1BEEF)>("128-81");
+	bench<128, 95, MCG, M(0x7EADBEEF)>("128-95");
+	bench<128, 96, MCG, M(0xDEADBEEF)>("128-96");
+	bench<128, 128, MCG, M(0xDEADBEEFDEADBEEF)>("128-128");
+}
+
+int main(int argc, char *argv[]) {
+	bool mcg = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "mdb:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mcg = true;
+			break;
+		case 'd':
+			deinterleaved = true;
+			break;
+		case 'b':
+			buffer_size = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != 2 || buffer_size == 0 || buffer_size % 16 != 0) {
+		cerr << "USAGE: " << argv[0] << " [-m] [-d] [-b SIZE] ITERATIONS" << endl << endl;
+		cerr << "Measures the throughput in GB/s of the generation of ITERATIONS values" << endl;
+		cerr << "for each state and multiplier size (in the form STATE-MULTIPLIER) by" << endl;
+		cerr << "a single LCG (MCG with -m) and by 4, 8 and 16 streams generated in" << endl;
+		cerr << "lockstep, filling repeatedly a buffer of SIZE values (default: 4096," << endl;
+		cerr << "must be a multiple of 16) with interleaved output (de-interleaved" << endl;
+		cerr << "with -d)." << endl;
+		exit(1);
+	}
+
+	iterations = strtoull(argv[1], NULL, 0);
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+	printf("# AVX-512\n");
+#elif defined(__AVX2__)
+	printf("# AVX2\n");
+#else
+	printf("# Portable\n");
+#endif
+	printf("# %s, GB/s\n", mcg ? "MCG" : "LCG");
+	printf("#size\t1\t4\t8\t16\n");
+	if (mcg) bench_all<true>();
+	else bench_all<false>();
+	return 0;
+}
@@ -8,13 +8,14 @@ See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
 /* Writes input files for LatticeTester (https://github.com/umontreal-simul/latticetester).
 
-   If MULT is defined, outputs data for an MCG with power-of-two modulus;
-   otherwise, for a full-period congruential generator, including LCGs with
-   power-of-two moduli and MCGs with prime moduli (note that in the latter case
-   no primitivity check is performed). */
+   With -m (or if invoked as mprintdat), outputs data for an MCG with
+   power-of-two modulus; otherwise, for a full-period congruential generator,
+   including LCGs with power-of-two moduli and MCGs with prime moduli (note
+   that in the latter case no primitivity check is performed). */
 
 #include <iostream>
 #include <fstream>
+#include <getopt.h>
 #include <NTL/LLL.h>
 
 using namespace NTL;
@@ -22,16 +23,30 @@ using namespace std;
 #include "common.cpp"
 
 int main(int argc, char *argv[]) {
+	bool mcg = mcg_by_name(argv[0]);
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+m")) != -1) {
+		switch (opt) {
+		case 'm':
+			mcg = true;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if (argc != 6) {
-		cerr << "USAGE: " << argv[0] << " LAG MAXDIM MULTIPLIER MODULUS BASENAME" << endl << endl;
+		cerr << "USAGE: " << argv[0] << " [-m] LAG MAXDIM MULTIPLIER MODULUS BASENAME" << endl << endl;
 		cerr << "Prints input files for LatticeTester to compute the spectral" << endl;
-#ifdef MULT
-		cerr << "figures of merit for MCGs with power-of-two moduli" << endl;
-#else
 		cerr << "figures of merit for full-period congruential generators, including" << endl;
 		cerr << "LCGs with power-of-two moduli and MCGs with prime moduli (note " << endl;
 		cerr << "that in the latter case no primitivity check is performed)," << endl;
-#endif
+		cerr << "or, with -m (or if invoked as mprintdat), for MCGs with" << endl;
+		cerr << "power-of-two moduli," << endl;
 		cerr << "up to the specified maximum dimension for the given lag." << endl;
 		exit(1);
 	}
@@ -52,12 +67,10 @@ int main(int argc, char *argv[]) {
 
 	ZZ a = strtoZZ(argv[3]);
 	ZZ mod = strtoZZ(argv[4]);
-#ifdef MULT
-	if ((mod & (mod - 1)) != 0) {
+	if (mcg && (mod & (mod - 1)) != 0) {
 		cerr << "The modulus must be a power of two" << endl;
 		exit(1);
 	}
-#endif
 
 	if (a >= mod) {
 		cerr << "The multiplier must be smaller than the modulus" << endl;
@@ -72,10 +85,8 @@ int main(int argc, char *argv[]) {
 	// Entacher's characterization of lagged lattices (https://dl.acm.org/doi/10.1145/301677.301682)
 	ZZ alag = PowerMod(a, lag, mod);
 	mod /= GCD(mod, conv<ZZ>(lag));
-#ifdef MULT
 	// See Knuth TAoCP Vol. 2, 3.3.4, Exercise 20.
-	mod /= 4;
-#endif
+	if (mcg) mod /= 4;
 
 	for (int d = 2; d <= max_dim; d++) {
 		ofstream s;
@@ -7,11 +7,12 @@ worldwide. This software is distributed without any warranty.
 See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
 /* Searches for multipliers with good spectral properties by testing random
-   candidates. Please see below where to insert your own candidate generation
-   procedure.
+   candidates. Please see candidates.cpp for the available candidate
+   generation strategies, and to add your own.
 
-   If MULT is defined, searches for multipliers for maximum-period MCGs with
-   power-of-two moduli; otherwise, for full-period LCGs with power-of-two moduli.
+   With -m (or if invoked as msearch), searches for multipliers for
+   maximum-period MCGs with power-of-two moduli; otherwise, for full-period
+   LCGs with power-of-two moduli.
 
    See also Karl Entacher & Thomas Schell's code associated with the paper
 
@@ -25,25 +26,219 @@ See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 */
 
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <NTL/LLL.h>
 
 using namespace NTL;
 using namespace std;
 #include "common.cpp"
+#include "lll.cpp"
+#include "spectral.cpp"
+#include "dbformat.cpp"
+#include "candidates.cpp"
+#include "evaluate.cpp"
+
+/* The state of a search after all blocks before a given one have been printed.
+   Checkpoints are saved as text files, and replaced atomically. */
+struct checkpoint {
+	string args; // The parameters affecting the output, which must match when resuming
+	int64_t block = 0; // The first block not printed yet
+	xoshiro256 gen; // The generator for block
+	int64_t offset = 0; // The length of the output file
+	// rejected[d] is the number of candidates whose first figure of merit below the threshold (in evaluation order) was in dimension d
+	int64_t evaluated = 0, accepted = 0, rejected[dim_max + 1] = {};
+	// Number of failures of the fixed-width or floating-point reduction, and of differences with NTL in check mode
+	int64_t fallbacks = 0, mismatches = 0;
+
+	// Returns false if the file does not exist; aborts if it cannot be parsed.
+	bool load(const char *file) {
+		ifstream in(file);
+		if (! in) return false;
+		string key;
+		bool ok = getline(in, key, ' ') && key == "args" && getline(in, args);
+		while (ok && in >> key) {
+			if (key == "block") ok = bool(in >> block);
+			else if (key == "state") ok = bool(in >> hex >> gen.s[0] >> gen.s[1] >> gen.s[2] >> gen.s[3] >> dec);
+			else if (key == "offset") ok = bool(in >> offset);
+			else if (key == "evaluated") ok = bool(in >> evaluated);
+			else if (key == "accepted") ok = bool(in >> accepted);
+			else if (key == "rejected") for (int d = 2; ok && d <= dim_max; d++) ok = bool(in >> rejected[d]);
+			else if (key == "fallbacks") ok = bool(in >> fallbacks);
+			else if (key == "mismatches") ok = bool(in >> mismatches);
+			else ok = false;
+		}
+		if (! ok) {
+			cerr << "Unreadable checkpoint: " << file << endl;
+			exit(1);
+		}
+		return true;
+	}
+
+	void save(const char *file) const {
+		const string tmp = string(file) + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "w");
+		if (f == NULL) {
+			perror(tmp.c_str());
+			exit(1);
+		}
+		fprintf(f, "args %s\n", args.c_str());
+		fprintf(f, "block %lld\n", (long long)block);
+		fprintf(f, "state %016llx %016llx %016llx %016llx\n", (unsigned long long)gen.s[0], (unsigned long long)gen.s[1], (unsigned long long)gen.s[2], (unsigned long long)gen.s[3]);
+		fprintf(f, "offset %lld\n", (long long)offset);
+		fprintf(f, "evaluated %lld\n", (long long)evaluated);
+		fprintf(f, "accepted %lld\n", (long long)accepted);
+		fprintf(f, "rejected");
+		for (int d = 2; d <= dim_max; d++) fprintf(f, " %lld", (long long)rejected[d]);
+		fprintf(f, "\nfallbacks %lld\n", (long long)fallbacks);
+		fprintf(f, "mismatches %lld\n", (long long)mismatches);
+		if (fflush(f) != 0 || fsync(fileno(f)) != 0 || fclose(f) != 0 || rename(tmp.c_str(), file) != 0) {
+			perror(file);
+			exit(1);
+		}
+	}
+};
+
+// A block to be evaluated by a worker process, and the generator for the block
+struct block_request {
+	int64_t k;
+	xoshiro256 gen;
+};
 
-// Only multipliers with a minimum spectral score larger than this value will be printed.
-const double threshold = 0.70;
+// Set by SIGINT and SIGTERM when checkpointing
+static volatile sig_atomic_t stop = 0;
+
+static void stop_handler(int) { stop = 1; }
 
 int main(int argc, char *argv[]) {
 
+	search_options o;
+	int threads = 1, processes = 0, strategy = -1, opt;
+	bool mcg = mcg_by_name(argv[0]);
+	const char *dim_order = NULL, *output = NULL, *checkpoint_file = NULL, *status_file = NULL;
+	int interval = 300, status_interval = 0;
+	long long shard = 0, shards = 1;
+
+	static const struct option options[] = {
+		{ "shard", required_argument, NULL, 's' },
+		{ "binary", optional_argument, NULL, 'b' },
+		{ "status", required_argument, NULL, 'T' },
+		{ "generator", required_argument, NULL, 'g' },
+		{ "mcg", no_argument, NULL, 'm' },
+		{ "top", required_argument, NULL, 'H' },
+		{ "top-min", required_argument, NULL, 'M' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "+j:P:pd:fFcil:o:C:I:S:g:m", options, NULL)) != -1) {
+		switch (opt) {
+		case 'm':
+			mcg = true;
+			break;
+		case 'H':
+		case 'M':
+			(opt == 'H' ? o.top_harm : o.top_min) = strtoll(optarg, NULL, 0);
+			if ((opt == 'H' ? o.top_harm : o.top_min) < 1) {
+				cerr << "The number of candidates to keep must be strictly positive" << endl;
+				exit(1);
+			}
+			break;
+		case 'S':
+			status_interval = atoi(optarg);
+			break;
+		case 'T':
+			status_file = optarg;
+			break;
+		case 'g':
+			strategy = strategy_by_name(optarg);
+			if (strategy == -1) {
+				cerr << "Unknown candidate generator: " << optarg << endl;
+				exit(1);
+			}
+			break;
+		case 'b':
+			o.score_bytes = optarg == NULL ? 4 : atoi(optarg);
+			if (o.score_bytes != 4 && o.score_bytes != 8) {
+				cerr << "Scores can be stored using 4 or 8 bytes" << endl;
+				exit(1);
+			}
+			break;
+		case 'P':
+			processes = atoi(optarg);
+			if (processes <= 0) processes = thread::hardware_concurrency();
+			break;
+		case 's':
+			if (sscanf(optarg, "%lld/%lld", &shard, &shards) != 2 || shards < 1 || shard < 0 || shard >= shards) {
+				cerr << "Invalid shard: " << optarg << endl;
+				exit(1);
+			}
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) threads = thread::hardware_concurrency();
+			break;
+		case 'p':
+			o.prune = true;
+			break;
+		case 'd':
+			dim_order = optarg;
+			break;
+		case 'i':
+			o.incremental = true;
+			break;
+		case 'l':
+			o.lags = atoi(optarg);
+			if (o.lags < 1) {
+				cerr << "The number of lags must be strictly positive" << endl;
+				exit(1);
+			}
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'C':
+			checkpoint_file = optarg;
+			break;
+		case 'I':
+			interval = atoi(optarg);
+			break;
+		case 'F':
+			o.fp = true;
+			break;
+		case 'c':
+			o.check = true;
+			// fall through
+		case 'f':
+			o.fixed = true;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if (argc != 5 && argc != 6) {
-		cerr << "USAGE: " << argv[0] << " SEED MAXDIM MODULUS MSIZE [ITERS]" << endl << endl;
+		cerr << "USAGE: " << argv[0] << " [-m] [-j THREADS | -P PROCESSES] [--shard I/N] [-p] [-d ORDER] [-f | -c] [-F] [-i] [-l LAGS] [--binary[=BYTES]] [-o FILE [-C CHECKPOINT [-I SECONDS]]] [-S SECONDS] [--status FILE] [-g GENERATOR] [--top K] [--top-min K] SEED MAXDIM MODULUS MSIZE [ITERS]" << endl << endl;
 		cerr << "Searches for multipliers with good spectral properties for" << endl;
-#ifdef MULT
-		cerr << "MCGs with power-of-two moduli by testing random candidates using" << endl;
-#else
-		cerr << "LCGs with power-of-two moduli by testing random candidates using" << endl;
-#endif
+		cerr << "LCGs (with -m, or if invoked as msearch, MCGs) with power-of-two" << endl;
+		cerr << "moduli by testing random candidates using" << endl;
 		cerr << "the LLL lattice-reduction algorithm. For each multiplier with" << endl;
 		cerr << "minimium figure of merit larger than " << threshold << " prints the minimum" << endl;
 		cerr << "spectral score, the harmonic spectral score, the multiplier" << endl;
@@ -53,17 +248,91 @@ int main(int argc, char *argv[]) {
 		cerr << "is negative, -ITER multipliers of MSIZE bits are tested starting" << endl;
 		cerr << "from SEED * 8 + 5; otherwise, SEED is used to seed a pseudorandom" << endl;
 		cerr << "number generator that generates multipliers of MSIZE bits." << endl;
+		cerr << "With --generator (or -g), candidates are generated using the given" << endl;
+		cerr << "strategy: uniform (random multipliers, the default), exhaustive (the" << endl;
+		cerr << "same as a negative ITER), stratified (a randomly shifted" << endl;
+		cerr << "low-discrepancy sequence), hill (hill climbing from the multipliers" << endl;
+		cerr << "passing the threshold, flipping random bits and moving to candidates" << endl;
+		cerr << "with better harmonic score) or anneal (simulated annealing, which" << endl;
+		cerr << "moves also to worse candidates with decreasing probability). Local" << endl;
+		cerr << "searches restart at each block of " << block_size << " candidates. At the end," << endl;
+		cerr << "the number of accepted multipliers per CPU-hour is printed." << endl;
+		cerr << "With -j, candidates are evaluated by the given number of threads" << endl;
+		cerr << "(0 means all available cores); the output does not depend on" << endl;
+		cerr << "the number of threads." << endl;
+		cerr << "With -P, candidates are evaluated by the given number of worker" << endl;
+		cerr << "processes (0 means all available cores) to which blocks of" << endl;
+		cerr << "candidates are handed out through pipes; the output is the same." << endl;
+		cerr << "With --shard I/N, only the I-th of N shards of the search is" << endl;
+		cerr << "performed (0 <= I < N). In the exhaustive case, shards are" << endl;
+		cerr << "contiguous ranges of multipliers, so concatenating the outputs of" << endl;
+		cerr << "all shards in order yields the output of the full search. To" << endl;
+		cerr << "enumerate all multipliers of MSIZE bits, use SEED 0 and ITERS" << endl;
+		cerr << "equal to -2^(MSIZE-4)." << endl;
+		cerr << "With -p, the evaluation of a candidate stops as soon as a figure" << endl;
+		cerr << "of merit is below the threshold. ORDER is a comma-separated" << endl;
+		cerr << "permutation of the dimensions from 2 to MAXDIM specifying the" << endl;
+		cerr << "evaluation order (e.g., 2,3,4,8,7,6,5). At the end, the number of" << endl;
+		cerr << "candidates rejected at each dimension is printed on standard error." << endl;
+		cerr << "With -f, lattices are reduced using fixed-width arithmetic when the" << endl;
+		cerr << "modulus is at most 2^128, falling back to NTL in case of failure;" << endl;
+		cerr << "-c does the same, but also reduces each lattice with NTL and reports" << endl;
+		cerr << "differences in figures of merit." << endl;
+		cerr << "With -F, lattices (not reduced using fixed-width arithmetic) are" << endl;
+		cerr << "reduced using NTL's floating-point LLL, and the result is verified" << endl;
+		cerr << "using NTL's exact LLL, falling back to the latter in case of loss of" << endl;
+		cerr << "precision; with -c, differences are reported as above." << endl;
+		cerr << "With -i, whenever dimension d is evaluated right after dimension" << endl;
+		cerr << "d - 1 the reduced basis of dimension d - 1 is extended rather than" << endl;
+		cerr << "reducing a new basis from scratch." << endl;
+		cerr << "With -l, for each multiplier passing the threshold the figures of" << endl;
+		cerr << "merit for lags from 2 to LAGS are computed, too, and the output has" << endl;
+		cerr << "the format of the aggregate files generated by ../python/filter.sh:" << endl;
+		cerr << "minimum spectral score, minimum lagged score (the minimum of 1 and" << endl;
+		cerr << "of the minimum spectral scores for all lags), harmonic spectral" << endl;
+		cerr << "score, multiplier in decimal and hexadecimal and figures of merit." << endl;
+		cerr << "With --binary, output is written in the binary columnar format" << endl;
+		cerr << "described in dbformat.cpp, with scores stored using BYTES bytes" << endl;
+		cerr << "(4 or 8; default: 4); it can be converted to text using dbconv." << endl;
+		cerr << "With -o, output is written to FILE rather than to standard output." << endl;
+		cerr << "With -C, the state of the search is saved to CHECKPOINT every" << endl;
+		cerr << "SECONDS seconds (default: 300) and when receiving SIGINT or SIGTERM;" << endl;
+		cerr << "if CHECKPOINT exists, the search is resumed from the saved state," << endl;
+		cerr << "truncating FILE to the length it had when the state was saved." << endl;
+		cerr << "With -S, a status line with the number of candidates evaluated and" << endl;
+		cerr << "accepted and the evaluation rate is printed on standard error every" << endl;
+		cerr << "SECONDS seconds. With --status, a detailed status with, for each" << endl;
+		cerr << "dimension, the average reduction time and a histogram of the" << endl;
+		cerr << "figures of merit is written to FILE every SECONDS seconds (default:" << endl;
+		cerr << "60) and at the end of the search. The number of candidates per" << endl;
+		cerr << "second and the average reduction time in each dimension are always" << endl;
+		cerr << "printed at the end." << endl;
+		cerr << "With --top, only the K candidates with the best harmonic score are" << endl;
+		cerr << "kept in memory, and they are printed at the end (in the same order" << endl;
+		cerr << "as in the full output); with --top-min, the same happens for the K" << endl;
+		cerr << "candidates with the best minimum score, and if both options are" << endl;
+		cerr << "given the union is printed. The score of the worst candidate kept" << endl;
+		cerr << "is a bar that rises during the search, and the evaluation of a" << endl;
+		cerr << "candidate stops as soon as it cannot beat it (for the harmonic" << endl;
+		cerr << "score, using an upper bound on the figures of merit not computed" << endl;
+		cerr << "yet that holds for all LLL-reduced bases; this is not done with" << endl;
+		cerr << "local searches). The number of candidates stopped in this way is" << endl;
+		cerr << "printed at the end; as it depends on how fast the bars rise, it" << endl;
+		cerr << "(and the other statistics) may vary with the number of threads." << endl;
+		cerr << "The output does not depend on the number of threads. Top-K mode" << endl;
+		cerr << "is incompatible with -P and -C; with --shard, each shard prints its" << endl;
+		cerr << "best candidates." << endl;
 		exit(1);
 	}
 
 	char *end = NULL;
-	uint64_t seed = strtoll(argv[1], &end, 0);
+	const uint64_t seed = o.seed = strtoll(argv[1], &end, 0);
 	if (*end) {
 		cerr << "Unreadable seed: " << argv[1] << endl;
 		exit(1);
 	}
 
-	const int max_dim = strtoll(argv[2], &end, 0);
+	const int max_dim = o.max_dim = strtoll(argv[2], &end, 0);
 	if (*end) {
 		cerr << "Unreadable maximum dimension: " << argv[2] << endl;
 		exit(1);
@@ -96,95 +365,345 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	int64_t iters = argc == 6 ? strtoll(argv[5], &end, 0) : numeric_limits<int64_t>::max();
+	o.set_order(dim_order);
 
-	const bool random = iters >= 0;	
-	if (! random) iters = -iters;
+	int64_t iters = argc == 6 ? strtoll(argv[5], &end, 0) : numeric_limits<int64_t>::max();
 
 	if (*end) {
 		cerr << "Unreadable number of iterations: " << argv[5] << endl;
 		exit(1);
 	}
 
-	const ZZ multiplier_surround_bits = conv<ZZ>(1) << (multiplier_size - 1) | 5;
-	const ZZ multiplier_mask = (conv<ZZ>(1) << (multiplier_size - 1)) - 8;
+	// A negative number of iterations implies an exhaustive search
+	const int default_strategy = iters >= 0 ? UNIFORM : EXHAUSTIVE;
+	if (iters < 0) {
+		if (strategy != -1 && strategy != EXHAUSTIVE) {
+			cerr << "A negative number of iterations requires an exhaustive search" << endl;
+			exit(1);
+		}
+		iters = -iters;
+	}
+	if (strategy == -1) strategy = default_strategy;
+	const bool random = strategy != EXHAUSTIVE;
+
+	if (processes > 0) threads = processes;
+
+	/* The blocks of the search are numbered from 0 to total - 1, and this
+	   shard evaluates blocks first, first + stride, ... (blocks in number).
+	   In the exhaustive case, shards are contiguous ranges of blocks;
+	   otherwise, they are interleaved, as a random search might be
+	   infinite, and jumping to the start of a range would be expensive. */
+	const int64_t total = (iters - 1) / block_size + 1;
+	int64_t first, stride, blocks;
+	if (random) {
+		first = shard;
+		stride = shards;
+		blocks = total > first ? (total - first - 1) / stride + 1 : 0;
+	}
+	else {
+		first = (__int128)total * shard / shards;
+		stride = 1;
+		blocks = (__int128)total * (shard + 1) / shards - first;
+	}
 
-	if ((conv<ZZ>(1) << multiplier_size) > mod) {
-		cerr << "Multiplier size too large for modulus: " << multiplier_size << endl;
+	if (o.score_bytes != 0 && multiplier_size > 128) {
+		cerr << "Binary output supports multipliers of at most 128 bits" << endl;
 		exit(1);
 	}
 
-	init(seed << 8 | multiplier_size);
-	cerr << (random ? "Seed: 0x" : "Start: 0x") << hex << seed << endl;
-	cerr << "Maximum dimension: " << dec << max_dim << endl;
-	cerr << "Modulus: " << mod << endl;
-	cerr << "Multiplier size: " << dec << multiplier_size << " bits " << endl;
-
-#ifdef MULT
-	// See Knuth TAoCP Vol. 2, 3.3.4, Exercise 20.
-	mod /= 4;
-#endif
-	RR sqrt_mod = sqrt(conv<RR>(mod));
+	// Status lines are printed only if requested explicitly
+	const bool status_lines = status_interval > 0;
+	if (status_file != NULL && status_interval <= 0) status_interval = 60;
 
-	// Compute the normalization factor starting from gamma_t
-	for(int d = 2; d <= dim_max; d++)
-		norm[d - 2] = conv<double>(conv<RR>(1) / (pow(conv<RR>(norm[d - 2]), conv<RR>(1./2)) * pow(conv<RR>(mod), conv<RR>(1) / conv<RR>(d))));
+	if (o.top() && (processes > 0 || checkpoint_file != NULL)) {
+		cerr << "Top-K mode is incompatible with worker processes (-P) and checkpointing (-C)" << endl;
+		exit(1);
+	}
 
-	ZZ a;
-	mat_ZZ mat;
-	double cur_fm[dim_max];
-	double harm_norm = 0;
+	if (checkpoint_file != NULL && output == NULL) {
+		cerr << "Checkpointing requires an output file (-o)" << endl;
+		exit(1);
+	}
 
-	for (int d = 2; d <= max_dim; d++) harm_norm += 1. / (d - 1);
+	if ((conv<ZZ>(1) << multiplier_size) > mod) {
+		cerr << "Multiplier size too large for modulus: " << multiplier_size << endl;
+		exit(1);
+	}
 
-	for (int64_t c = 0; c < iters; c++) {
-		/* We generate only full-period multipliers of maximum potency, and,
-		   in the multiplicative case, maximum-period multipliers whose
-		   lattice of upper bits (minus the lowest two) is a translated
-		   and scaled version of the lattice on all bits. In both cases,
-		   these are exactly the multipliers whose residue modulo 8 is 5. */
-		if (random) {
-		    // Insert here your preferred candidate generation scheme
-		    // Random odd multiplier in the range [2^(multiplier_size-1)..2^multiplier_size) whose residual modulo 8 is 5; it fits in multiplier_size bits
-#if defined(__clang__) && defined(__APPLE__)
+	block_evaluator ev(o, mod, mcg, multiplier_size, iters, (candidate_strategy)strategy);
+
+	checkpoint cp;
+	ostringstream args;
+	for (int i = 1; i < argc; i++) args << argv[i] << " ";
+	if (mcg) args << "mult ";
+	args << "lags " << o.lags << " shard " << shard << "/" << shards << " binary " << o.score_bytes;
+	if (strategy != default_strategy) args << " generator " << strategy_names[strategy];
+	// Different reductions (and, for incremental reduction, different orders) may give different figures of merit
+	args << " reduction " << (o.fixed ? "fixed" : "NTL") << (o.fp ? ",fp" : "") << (o.check ? ",check" : "") << (o.incremental ? ",incremental" : "");
+	args << " order " << o.order[0];
+	for (int i = 1; i < max_dim - 1; i++) args << "," << o.order[i];
+	cp.args = args.str();
+	cp.gen.init(seed << 8 | multiplier_size);
+	if (random) for (int64_t i = 0; i < first; i++) cp.gen.jump();
+
+	const bool resume = checkpoint_file != NULL && cp.load(checkpoint_file);
+	if (resume && cp.args != args.str()) {
+		cerr << "The checkpoint " << checkpoint_file << " was saved by a search with different parameters: " << cp.args << endl;
+		exit(1);
+	}
 
-			// https://github.com/libntl/ntl/issues/28
-			a = ((((conv<ZZ>(0) + (unsigned long)next()) << 192) + ((conv<ZZ>(0) + (unsigned long)next()) << 128) + ((conv<ZZ>(0) + (unsigned long)next()) << 64) + conv<ZZ>((unsigned long)next())) & multiplier_mask) | multiplier_surround_bits;
-#else
-			a = ((((conv<ZZ>(0) + next()) << 192) + ((conv<ZZ>(0) + next()) << 128) + ((conv<ZZ>(0) + next()) << 64) + conv<ZZ>(next())) & multiplier_mask) | multiplier_surround_bits;
-#endif
+	FILE *output_file = stdout;
+	if (output != NULL) {
+		output_file = fopen(output, resume ? "r+" : "w");
+		if (output_file == NULL || (resume && (ftruncate(fileno(output_file), cp.offset) != 0 || fseeko(output_file, cp.offset, SEEK_SET) != 0))) {
+			perror(output);
+			exit(1);
 		}
-		else a = ((((conv<ZZ>(0) + c) + seed) * 8) & multiplier_mask) | multiplier_surround_bits;
+	}
 
-		double min_fm = numeric_limits<double>::infinity(), harm_score = 0;
+	db_writer *db = NULL;
+	if (o.score_bytes != 0) db = new db_writer(output_file, ev.header(), ! resume);
 
-		mat.SetDims(1, 1); // Reset
+	if (checkpoint_file != NULL) {
+		signal(SIGINT, stop_handler);
+		signal(SIGTERM, stop_handler);
+	}
 
+	cerr << (random ? "Seed: 0x" : "Start: 0x") << hex << seed << endl;
+	cerr << "Generator: " << strategy_names[strategy] << endl;
+	cerr << "Maximum dimension: " << dec << max_dim << endl;
+	cerr << "Type: " << (mcg ? "MCG" : "LCG") << endl;
+	cerr << "Modulus: " << mod << endl;
+	cerr << "Multiplier size: " << dec << multiplier_size << " bits " << endl;
+	cerr << (processes > 0 ? "Processes: " : "Threads: ") << threads << endl;
+	if (shards > 1) cerr << "Shard: " << shard << "/" << shards << " (" << blocks << " blocks of " << block_size << " candidates)" << endl;
+	cerr << "Dimension order:";
+	for (int i = 0; i < max_dim - 1; i++) cerr << " " << o.order[i];
+	cerr << (o.prune ? " (pruning)" : "") << endl;
+	cerr << "Reduction: " << (o.fixed ? (o.fp ? "fixed-width, floating-point" : "fixed-width") : o.fp ? "floating-point" : "NTL") << (o.incremental ? ", incremental" : "") << (o.check ? " (checked against NTL)" : "") << endl;
+	if (o.lags > 1) cerr << "Lags: 1-" << o.lags << endl;
+	if (o.top_harm != 0) cerr << "Keeping the best " << o.top_harm << " candidates by harmonic score" << endl;
+	if (o.top_min != 0) cerr << "Keeping the best " << o.top_min << " candidates by minimum score" << endl;
+	if (resume) cerr << "Resuming from block " << cp.block << " (" << cp.evaluated << " candidates evaluated)" << endl;
+
+	if (o.fixed && ! ev.fixed()) cerr << "Modulus too large for fixed-width reduction: using NTL" << endl;
+
+	mutex m; // Protects the variables below, cp and output_file
+	xoshiro256 gen = cp.gen; // The generator for next_block
+	int64_t next_block = cp.block, next_print = cp.block;
+	map<int64_t, xoshiro256> started; // Generators of the blocks being evaluated
+	map<int64_t, block_result> pending; // Completed blocks waiting to be printed
+	time_t last_save = time(NULL), last_status = time(NULL);
+	eval_stats stats; // Statistics of the printed blocks
+	stats.clear();
+	int64_t run_evaluated = 0, run_accepted = 0; // Candidates evaluated and accepted by this run (excluding those of a resumed checkpoint)
+	int64_t pruned = 0; // Candidates stopped by the bars of top-K mode
+	const auto start_time = chrono::steady_clock::now();
+
+	auto elapsed = [&]() { return chrono::duration<double>(chrono::steady_clock::now() - start_time).count(); };
+
+	// Prints a status line on standard error.
+	auto print_status = [&]() {
+		char buf[256];
+		const double e = elapsed();
+		snprintf(buf, sizeof buf, "Status: %.0f s, %lld evaluated (%.1f/s), %lld accepted (%.6f%%)", e, (long long)cp.evaluated, run_evaluated / e, (long long)cp.accepted, cp.evaluated != 0 ? 100. * cp.accepted / cp.evaluated : 0.);
+		cerr << buf << endl;
+	};
+
+	// Writes the detailed status to status_file, replacing it atomically.
+	auto write_status = [&]() {
+		const string tmp = string(status_file) + ".tmp";
+		FILE * const f = fopen(tmp.c_str(), "w");
+		if (f == NULL) {
+			perror(tmp.c_str());
+			exit(1);
+		}
+		const double e = elapsed();
+		fprintf(f, "elapsed %.3f\n", e);
+		fprintf(f, "evaluated %lld\n", (long long)cp.evaluated);
+		fprintf(f, "accepted %lld\n", (long long)cp.accepted);
+		fprintf(f, "rate %.3f\n", run_evaluated / e);
+		fprintf(f, "# dimension, figures of merit computed, rejected candidates, average time (us), histogram of figures of merit\n");
+		fprintf(f, "#dim\tcount\trejected\ttime");
+		for (int b = 0; b < hist_bins; b++) fprintf(f, "\t[%.2f,%.2f)", b / (double)hist_bins, (b + 1) / (double)hist_bins);
+		fprintf(f, "\n");
 		for (int d = 2; d <= max_dim; d++) {
-			mat.SetDims(d, d);
-			// Dual lattice (see Knuth TAoCP Vol. 2, 3.3.4/B*).
-			mat[0][0] = mod;
-			for (int i = 1; i < d; i++) mat[i][i] = 1;
-			for (int i = 1; i < d; i++) mat[i][0] = -power(a, i);
-			ZZ det2;
-			// LLL reduction with delta = 0.999999999
-			LLL(det2, mat, 999999999, 1000000000);
-
-			double min2 = numeric_limits<double>::infinity();
-			for (int i = 0; i < d; i++) min2 = min(min2, conv<double>(mat[i] * mat[i]));
-
-			cur_fm[d - 2] = norm[d - 2] * sqrt(min2);
-			min_fm = min(min_fm, cur_fm[d - 2]);
-			harm_score += cur_fm[d - 2] / (d - 1);
+			fprintf(f, "%d\t%lld\t%lld\t%.3f", d, (long long)stats.count[d], (long long)cp.rejected[d], stats.timed[d] != 0 ? stats.nanos[d] / 1E3 / stats.timed[d] : 0.);
+			for (int b = 0; b < hist_bins; b++) fprintf(f, "\t%lld", (long long)stats.hist[d][b]);
+			fprintf(f, "\n");
 		}
+		if (fclose(f) != 0 || rename(tmp.c_str(), status_file) != 0) {
+			perror(status_file);
+			exit(1);
+		}
+	};
+
+	// Saves a checkpoint after next_print - 1 has been printed.
+	auto save = [&]() {
+		if (db != NULL) db->flush();
+		if (fflush(output_file) != 0 || fsync(fileno(output_file)) != 0) {
+			perror(output);
+			exit(1);
+		}
+		cp.block = next_print;
+		cp.offset = ftello(output_file);
+		const auto s = started.find(next_print);
+		cp.gen = s != started.end() ? s->second : gen;
+		cp.save(checkpoint_file);
+		last_save = time(NULL);
+	};
+
+	// Worker processes (-P) receive block requests and send back results through pipes.
+	vector<int> requests, results;
+	vector<pid_t> children;
+	for (int p = 0; p < processes; p++) {
+		int req[2], res[2];
+		if (pipe(req) != 0 || pipe(res) != 0) {
+			perror("pipe");
+			exit(1);
+		}
+		const pid_t pid = fork();
+		if (pid == -1) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid == 0) {
+			for (int fd : requests) close(fd);
+			for (int fd : results) close(fd);
+			close(req[1]);
+			close(res[0]);
+			// The coordinator handles signals, and closes the pipe when done
+			if (checkpoint_file != NULL) {
+				signal(SIGINT, SIG_IGN);
+				signal(SIGTERM, SIG_IGN);
+			}
+			vector<spectral_eval> evals = ev.evals();
+			candidate_generator cg = ev.generator();
+			block_request q;
+			block_result r;
+			while (read_fully(req[0], &q, sizeof q)) {
+				ev.evaluate(evals, cg, q.k, q.gen, r);
+				r.write(res[1]);
+			}
+			_exit(0);
+		}
+		close(req[0]);
+		close(res[1]);
+		requests.push_back(req[1]);
+		results.push_back(res[0]);
+		children.push_back(pid);
+	}
 
-		harm_score /= harm_norm;
-
-		if (min_fm >= threshold) {
-			printf("%8.6f\t%8.6f\t", min_fm, harm_score);
-			cout << a << "\t" << "0x" << hex(a);
-			for (int d = 2; d <= max_dim; d++) printf("\t%8.6f", cur_fm[d - 2]);
-			printf("\n");
+	// Worker t evaluates blocks itself, or through worker process t.
+	auto worker = [&](const int t) {
+		xoshiro256 r;
+		block_result res;
+		vector<spectral_eval> evals;
+		if (processes == 0) evals = ev.evals();
+		candidate_generator cg = ev.generator();
+
+		for(;;) {
+			m.lock();
+			if (stop || next_block >= blocks) {
+				m.unlock();
+				return;
+			}
+			// j is the index of the block within the shard, k is the index of the block within the search
+			const int64_t j = next_block++, k = first + j * stride;
+			r = started[j] = gen;
+			if (random) for (int64_t i = 0; i < stride; i++) gen.jump();
+			m.unlock();
+
+			if (processes == 0) ev.evaluate(evals, cg, k, r, res);
+			else {
+				const block_request q = { k, r };
+				write_fully(requests[t], &q, sizeof q);
+				if (! res.read(results[t])) {
+					cerr << "Worker process " << children[t] << " terminated unexpectedly" << endl;
+					exit(1);
+				}
+			}
+
+			m.lock();
+			pending[j] = move(res);
+			// Print completed blocks in order
+			for(auto p = pending.begin(); p != pending.end() && p->first == next_print; p = pending.erase(p), next_print++) {
+				const block_result &b = p->second;
+				if (db != NULL) db->add(b.out);
+				else fputs(b.out.c_str(), output_file);
+				cp.evaluated += b.evaluated;
+				cp.accepted += b.accepted;
+				for (int d = 2; d <= max_dim; d++) cp.rejected[d] += b.rejected[d];
+				cp.fallbacks += b.fallbacks;
+				cp.mismatches += b.mismatches;
+				stats.merge(b.stats);
+				run_evaluated += b.evaluated;
+				run_accepted += b.accepted;
+				pruned += b.pruned;
+				started.erase(p->first);
+			}
+			fflush(output_file);
+			if (checkpoint_file != NULL && time(NULL) - last_save >= interval) save();
+			if (status_interval > 0 && time(NULL) - last_status >= status_interval) {
+				if (status_lines) print_status();
+				if (status_file != NULL) write_status();
+				last_status = time(NULL);
+			}
+			m.unlock();
 		}
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) pool.emplace_back(worker, t);
+	for (auto &t : pool) t.join();
+
+	for (int fd : requests) close(fd);
+	for (pid_t pid : children) waitpid(pid, NULL, 0);
+
+	if (o.top()) {
+		if (ev.harm_heap.full()) cerr << "Harmonic score bar: " << ev.harm_heap.bar() << endl;
+		if (ev.min_heap.full()) cerr << "Minimum score bar: " << ev.min_heap.bar() << endl;
+		const map<int64_t, string> kept = ev.kept();
+		for (const auto &e : kept) {
+			if (db != NULL) db->add(e.second);
+			else fputs(e.second.c_str(), output_file);
+		}
+		cerr << "Kept: " << kept.size() << endl;
 	}
+
+	if (db != NULL) db->flush();
+	if (checkpoint_file != NULL) {
+		save();
+		if (stop) cerr << "Interrupted: checkpoint saved at block " << cp.block << endl;
+	}
+	delete db;
+	if (output_file != stdout) fclose(output_file);
+
+	if (status_file != NULL) write_status();
+
+	char buf[256];
+	const double e = elapsed();
+	cerr << "Evaluated: " << cp.evaluated << endl;
+	cerr << "Accepted: " << cp.accepted << endl;
+	if (ev.top_prune) cerr << "Stopped by the top-K bars: " << pruned << endl;
+	for (int d = 2; d <= max_dim; d++) cerr << "Rejected at dimension " << d << ": " << cp.rejected[d] << endl;
+	snprintf(buf, sizeof buf, "Elapsed time: %.3f s (%.1f candidates/s)", e, run_evaluated / e);
+	cerr << buf << endl;
+	// CPU time of all threads, and of worker processes, which have been waited for
+	double cpu = 0;
+	for (const int who : { RUSAGE_SELF, RUSAGE_CHILDREN }) {
+		struct rusage u;
+		getrusage(who, &u);
+		cpu += u.ru_utime.tv_sec + u.ru_stime.tv_sec + (u.ru_utime.tv_usec + u.ru_stime.tv_usec) / 1E6;
+	}
+	snprintf(buf, sizeof buf, "CPU time: %.3f s (%.1f accepted/CPU-hour)", cpu, cpu > 0 ? run_accepted / (cpu / 3600) : 0.);
+	cerr << buf << endl;
+	for (int d = 2; d <= max_dim; d++)
+		if (stats.timed[d] != 0) {
+			snprintf(buf, sizeof buf, "Average reduction time at dimension %d: %.3f us", d, stats.nanos[d] / 1E3 / stats.timed[d]);
+			cerr << buf << endl;
+		}
+	const char * const reduction = reduction_name(ev.fixed(), o.fp);
+	if (reduction != NULL) cerr << reduction << " reduction failures: " << cp.fallbacks << endl;
+	if (o.check) cerr << "Mismatches with NTL: " << cp.mismatches << endl;
 }
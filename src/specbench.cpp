@@ -0,0 +1,255 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Benchmark for the evaluation of candidates by search. For each type and
+   size of the databases processed by ../python/filterall.sh, generates a
+   fixed set of random candidates (in the same way as search, from a given
+   seed) and computes all their figures of merit up to the maximum
+   dimension, reporting candidates per second, the average time spent in
+   each dimension and the average number of memory allocations per
+   candidate. Figures of merit can be recorded to a golden file and later
+   checked against it, so that an optimization can be trusted only if it
+   does not change results.
+
+   Allocations are counted by interposing malloc(), calloc() and realloc()
+   (with glibc only), so allocations by NTL and GMP are counted, too. */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <getopt.h>
+#include <unistd.h>
+#include <NTL/LLL.h>
+
+using namespace NTL;
+using namespace std;
+
+#include "common.cpp"
+#include "lll.cpp"
+#include "spectral.cpp"
+
+#ifdef __GLIBC__
+extern "C" {
+	void *__libc_malloc(size_t);
+	void *__libc_calloc(size_t, size_t);
+	void *__libc_realloc(void *, size_t);
+}
+
+static atomic<int64_t> allocations(0);
+
+extern "C" void *malloc(size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	return __libc_realloc(p, size);
+}
+#endif
+
+// Types and sizes of ../python/filterall.sh
+static const struct {
+	bool mcg;
+	int state, bits[13];
+} configs[] = {
+	{ false, 32, { 16, 17, 18, 19, 24, 32 } },
+	{ false, 64, { 32, 33, 34, 35, 48, 64 } },
+	{ false, 128, { 64, 65, 66, 67, 68, 69, 70, 71, 72, 80, 96, 128 } },
+	{ true, 32, { 15, 16, 17, 18, 19, 24, 32 } },
+	{ true, 64, { 31, 32, 33, 34, 35, 48, 64 } },
+	{ true, 128, { 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 80, 96, 128 } },
+};
+
+int main(int argc, char *argv[]) {
+	bool fixed = false, fp = false, incremental = false;
+	int max_dim = 8, opt;
+	int64_t candidates = 1000;
+	uint64_t seed = 0;
+	double tolerance = 1E-12;
+	const char *golden_in = NULL, *golden_out = NULL;
+
+	while ((opt = getopt(argc, argv, "+fFin:s:d:g:w:t:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fixed = true;
+			break;
+		case 'F':
+			fp = true;
+			break;
+		case 'i':
+			incremental = true;
+			break;
+		case 'n':
+			candidates = strtoll(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			max_dim = atoi(optarg);
+			break;
+		case 'g':
+			golden_in = optarg;
+			break;
+		case 'w':
+			golden_out = optarg;
+			break;
+		case 't':
+			tolerance = strtod(optarg, NULL);
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (candidates < 1 || max_dim < 2 || max_dim > dim_max) {
+		cerr << "USAGE: " << argv[0] << " [-f] [-F] [-i] [-n CANDIDATES] [-s SEED] [-d MAXDIM] [-g GOLDEN [-t TOLERANCE] | -w GOLDEN] [TYPE-STATE-BITS...]" << endl << endl;
+		cerr << "Benchmarks the evaluation of candidates by search for each type and" << endl;
+		cerr << "size of ../python/filterall.sh (or for the given ones only): the given" << endl;
+		cerr << "number of random candidates (default: 1000), generated as search does" << endl;
+		cerr << "from the given seed (default: 0), are evaluated in all dimensions up" << endl;
+		cerr << "to MAXDIM (default: 8, between 2 and " << dim_max << "). For each configuration," << endl;
+		cerr << "prints the number of candidates evaluated per second, the average" << endl;
+		cerr << "number of memory allocations per candidate (with glibc only) and the" << endl;
+		cerr << "average time in microseconds spent in each dimension." << endl;
+		cerr << "-f, -F and -i select fixed-width, floating-point and incremental" << endl;
+		cerr << "reduction, as in search." << endl;
+		cerr << "With -w, figures of merit are written to the file GOLDEN; with -g," << endl;
+		cerr << "they are checked against those in GOLDEN, reporting differences larger" << endl;
+		cerr << "than TOLERANCE (relative; default: 1E-12), and the exit code is 2 if" << endl;
+		cerr << "there is any difference." << endl;
+		exit(1);
+	}
+
+	// Golden figures of merit, by configuration and candidate index
+	map<pair<string, int64_t>, pair<string, vector<double>>> golden;
+	if (golden_in != NULL) {
+		ifstream in(golden_in);
+		if (! in) {
+			perror(golden_in);
+			exit(1);
+		}
+		for (string line; getline(in, line); ) {
+			istringstream s(line);
+			string name, a;
+			int64_t i;
+			vector<double> fm;
+			s >> name >> i >> a;
+			for (double x; s >> x; ) fm.push_back(x);
+			golden[{ name, i }] = { a, fm };
+		}
+	}
+
+	ofstream out;
+	if (golden_out != NULL) {
+		out.open(golden_out);
+		if (! out) {
+			perror(golden_out);
+			exit(1);
+		}
+		out.precision(17);
+	}
+
+	vector<string> selected(argv + 1, argv + argc);
+	int64_t differences = 0;
+
+	printf("#config\tcand/s\tallocs/cand");
+	for (int d = 2; d <= max_dim; d++) printf("\tus(%d)", d);
+	printf("\n");
+
+	for (const auto &c : configs)
+		for (int b = 0; b < 13 && c.bits[b] != 0; b++) {
+			const int multiplier_size = c.bits[b];
+			const string name = string(c.mcg ? "MCG-" : "LCG-") + to_string(c.state) + "-" + to_string(multiplier_size);
+			if (! selected.empty() && find(selected.begin(), selected.end(), name) == selected.end()) continue;
+
+			const ZZ mod = conv<ZZ>(1) << c.state;
+			const ZZ multiplier_surround_bits = conv<ZZ>(1) << (multiplier_size - 1) | 5;
+			const ZZ multiplier_mask = (conv<ZZ>(1) << (multiplier_size - 1)) - 8;
+
+			// Candidates are generated as in search
+			xoshiro256 r;
+			r.init(seed << 8 | multiplier_size);
+			vector<ZZ> mults(candidates);
+			for (auto &a : mults) a = ((((conv<ZZ>(0) + r.next()) << 192) + ((conv<ZZ>(0) + r.next()) << 128) + ((conv<ZZ>(0) + r.next()) << 64) + conv<ZZ>(r.next())) & multiplier_mask) | multiplier_surround_bits;
+
+			const spectral_test test(mod, 1, c.mcg);
+			spectral_eval eval(test, fixed, false, incremental, fp);
+			double time[dim_max + 1] = {};
+			vector<double> fms(candidates * (max_dim - 1)); // The figures of merit of candidate i start at fms[i * (max_dim - 1)]
+			int64_t allocs = 0; // Allocations during evaluation, excluding golden-file handling
+			const auto start = chrono::steady_clock::now();
+
+			for (int64_t i = 0; i < candidates; i++) {
+#ifdef __GLIBC__
+				const int64_t start_allocations = allocations;
+#endif
+				eval.multiplier(mults[i]);
+				double * const fm = &fms[i * (max_dim - 1)];
+				for (int d = 2; d <= max_dim; d++) {
+					const auto t = chrono::steady_clock::now();
+					fm[d - 2] = eval.fm(d);
+					time[d] += chrono::duration<double, micro>(chrono::steady_clock::now() - t).count();
+				}
+#ifdef __GLIBC__
+				allocs += allocations - start_allocations;
+#endif
+			}
+
+			// Golden-file handling is not timed
+			const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+			for (int64_t i = 0; i < candidates; i++) {
+				const double * const fm = &fms[i * (max_dim - 1)];
+
+				if (golden_out != NULL) {
+					out << name << "\t" << i << "\t0x" << hex(mults[i]);
+					for (int d = 2; d <= max_dim; d++) out << "\t" << fm[d - 2];
+					out << "\n";
+				}
+
+				if (golden_in != NULL) {
+					const auto g = golden.find({ name, i });
+					bool same = g != golden.end() && g->second.first == "0x" + hex(mults[i]) && (int)g->second.second.size() >= max_dim - 1;
+					for (int d = 2; same && d <= max_dim; d++) same = fabs(fm[d - 2] - g->second.second[d - 2]) <= tolerance * fabs(g->second.second[d - 2]);
+					if (! same) {
+						differences++;
+						cerr << "Difference for " << name << ", candidate " << i << " (0x" << hex(mults[i]) << ")" << endl;
+					}
+				}
+			}
+
+#ifdef __GLIBC__
+			printf("%s\t%.1f\t%.1f", name.c_str(), candidates / elapsed, allocs / (double)candidates);
+#else
+			printf("%s\t%.1f\tnan", name.c_str(), candidates / elapsed);
+#endif
+			for (int d = 2; d <= max_dim; d++) printf("\t%.3f", time[d] / candidates);
+			printf("\n");
+			fflush(stdout);
+			if (eval.fallbacks != 0) cerr << name << ": " << reduction_name(eval.fixed, fp) << " reduction failed " << eval.fallbacks << " times: used NTL" << endl;
+		}
+
+	if (golden_in != NULL) {
+		if (differences != 0) cerr << "Figures of merit differing from " << golden_in << ": " << differences << endl;
+		else cerr << "All figures of merit match " << golden_in << endl;
+	}
+
+	return differences != 0 ? 2 : 0;
+}
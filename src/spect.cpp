@@ -7,8 +7,8 @@ worldwide. This software is distributed without any warranty.
 See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 
 /* Prints approximated figures of merit using the LLL lattice-reduction
-   algorithm. If MULT is defined, computes figures of merit for an MCG with
-   power-of-two modulus; otherwise, for a full-period congruential generator,
+   algorithm. With -m (or if invoked as mspect), computes figures of merit
+   for an MCG with power-of-two modulus; otherwise, for a full-period congruential generator,
    including LCGs with power-of-two moduli and MCGs with prime moduli (note
    that in the latter case no primitivity check is performed).
 
@@ -24,29 +24,118 @@ See <http://creativecommons.org/publicdomain/zero/1.0/>. */
 */
 
 #include <iostream>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <getopt.h>
+#include <unistd.h>
 #include <NTL/LLL.h>
 
 using namespace NTL;
 using namespace std;
 
 #include "common.cpp"
+#include "lll.cpp"
+#include "spectral.cpp"
+#include "dbformat.cpp"
 
 int main(int argc, char *argv[]) {
-	if (argc != 5) {
-		cerr << "USAGE: " << argv[0] << " LAG MAXDIM MULTIPLIER MODULUS" << endl << endl;
+	bool fixed = false, fp = false, exact = false, check = false, incremental = false, batch = false, mcg = mcg_by_name(argv[0]);
+	int threads = 1, column = 1, score_bytes = 0, opt;
+
+	static const struct option options[] = {
+		{ "stdin", no_argument, NULL, 's' },
+		{ "exact", no_argument, NULL, 'e' },
+		{ "binary", optional_argument, NULL, 'b' },
+		{ "mcg", no_argument, NULL, 'm' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "+fFecisj:k:m", options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			batch = true;
+			break;
+		case 'm':
+			mcg = true;
+			break;
+		case 'b':
+			score_bytes = optarg == NULL ? 4 : atoi(optarg);
+			if (score_bytes != 4 && score_bytes != 8) {
+				cerr << "Scores can be stored using 4 or 8 bytes" << endl;
+				exit(1);
+			}
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) threads = thread::hardware_concurrency();
+			break;
+		case 'k':
+			column = atoi(optarg);
+			if (column < 1) {
+				cerr << "Columns are numbered starting from 1" << endl;
+				exit(1);
+			}
+			break;
+		case 'i':
+			incremental = true;
+			break;
+		case 'F':
+			fp = true;
+			break;
+		case 'e':
+			exact = true;
+			break;
+		case 'c':
+			check = true;
+			// fall through
+		case 'f':
+			fixed = true;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != (batch ? 4 : 5)) {
+		cerr << "USAGE: " << argv[0] << " [-m] [-f | -c] [-F] [-e] [-i] [--binary[=BYTES]] LAG MAXDIM MULTIPLIER MODULUS" << endl;
+		cerr << "       " << argv[0] << " --stdin [-m] [-j THREADS] [-k COLUMN] [-f | -c] [-F] [-e] [-i] [--binary[=BYTES]] LAG MAXDIM MODULUS" << endl << endl;
 		cerr << "Uses the LLL lattice-reduction algorithm to approximate" << endl;
-#ifdef MULT
-		cerr << "figures of merit for MCGs with power-of-two moduli" << endl;
-#else
 		cerr << "figures of merit for full-period congruential generators, including" << endl;
 		cerr << "LCGs with power-of-two moduli and MCGs with prime moduli (note " << endl;
 		cerr << "that in the latter case no primitivity check is performed)," << endl;
-#endif
+		cerr << "or, with -m (or if invoked as mspect), for MCGs with power-of-two" << endl;
+		cerr << "moduli," << endl;
 		cerr << "up to the specified maximum dimension for the given lag." << endl;
 		cerr << "A lag of one gives the standard spectral test. Prints the minimum" << endl;
 		cerr << "spectral score, the harmonic spectral score, the multiplier" << endl;
 		cerr << "in decimal and hexadecimal, the lag and the figures of merit" << endl;
 		cerr << "up to the specified maximum dimension." << endl;
+		cerr << "With -f, lattices are reduced using fixed-width arithmetic when the" << endl;
+		cerr << "modulus is at most 2^128, falling back to NTL in case of failure;" << endl;
+		cerr << "-c does the same, but also reduces each lattice with NTL and reports" << endl;
+		cerr << "differences in figures of merit." << endl;
+		cerr << "With -F, lattices (not reduced using fixed-width arithmetic) are" << endl;
+		cerr << "reduced using NTL's floating-point LLL, and the result is verified" << endl;
+		cerr << "using NTL's exact LLL, falling back to the latter in case of loss of" << endl;
+		cerr << "precision; with -c, differences are reported as above." << endl;
+		cerr << "With --exact (or -e), figures of merit are computed exactly by" << endl;
+		cerr << "enumerating the shortest vector of the dual lattice starting from" << endl;
+		cerr << "the basis reduced by NTL (with -F, by the floating-point LLL);" << endl;
+		cerr << "-f and -c are ignored." << endl;
+		cerr << "With -i, the reduced basis of each dimension is extended to the" << endl;
+		cerr << "next dimension rather than reducing a new basis from scratch." << endl;
+		cerr << "With --stdin (or -s), multipliers are read from standard input, one per" << endl;
+		cerr << "line, from the specified TAB- or space-separated column (default: 1)," << endl;
+		cerr << "and scored using the given number of threads (0 means all available" << endl;
+		cerr << "cores); results are printed in input order." << endl;
+		cerr << "With --binary, output is written in the binary columnar format" << endl;
+		cerr << "described in dbformat.cpp, with scores stored using BYTES bytes" << endl;
+		cerr << "(4 or 8; default: 4), and the lag is recorded in the header." << endl;
 		exit(1);
 	}
 
@@ -69,61 +158,134 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	ZZ a = strtoZZ(argv[3]);
-	ZZ mod = strtoZZ(argv[4]);
-#ifdef MULT
-	if ((mod & (mod - 1)) != 0) {
+	ZZ mod = strtoZZ(argv[batch ? 3 : 4]);
+	if (mcg && (mod & (mod - 1)) != 0) {
 		cerr << "The modulus must be a power of two" << endl;
 		exit(1);
 	}
-#endif
 
-	if (a >= mod) {
-		cerr << "The multiplier must be smaller than the modulus" << endl;
-		exit(1);
+	const spectral_test test(mod, lag, mcg);
+
+	db_writer *db = NULL;
+	if (score_bytes != 0) {
+		db_header h;
+		h.mcg = mcg;
+		h.mult_bytes = 16;
+		h.score_bytes = score_bytes;
+		h.state = test.state_bits();
+		h.max_dim = max_dim;
+		h.lag = lag;
+		db = new db_writer(stdout, h);
 	}
 
-	// Entacher's characterization of lagged lattices (https://dl.acm.org/doi/10.1145/301677.301682)
-	ZZ alag = PowerMod(a, lag, mod);
-	mod /= GCD(mod, conv<ZZ>(lag));
-#ifdef MULT
-	// See Knuth TAoCP Vol. 2, 3.3.4, Exercise 20.
-	mod /= 4;
-#endif
-	// Compute the normalization factor starting from gamma_t
-	for(int d = 2; d <= dim_max; d++)
-		norm[d - 2] = to_double(to_RR(1) / (pow(to_RR(norm[d - 2]), to_RR(1./2)) * pow(to_RR(mod), to_RR(1) / to_RR(d))));
-
-	mat_ZZ mat;
-	mat.SetDims(max_dim, max_dim);
-
-	double harm_norm = 0, min_fm = numeric_limits<double>::infinity(), harm_score = 0, cur_fm[dim_max];
-
-	for (int d = 2; d <= max_dim; d++) {
-		mat.SetDims(d, d);
-		// Dual lattice (see Knuth TAoCP Vol. 2, 3.3.4/B*).
-		mat[0][0] = mod;
-		for (int i = 1; i < d; i++) mat[i][i] = 1;
-		for (int i = 1; i < d; i++) mat[i][0] = -power(alag, i);
-		ZZ det2;
-		// LLL reduction with delta = 0.999999999
-		LLL(det2, mat, 999999999, 1000000000);
-
-		double min2 = numeric_limits<double>::infinity();
-
-		for (int i = 0; i < d; i++) {
-			//cout << mat[i] << endl;
-			min2 = min(min2, to_double(mat[i] * mat[i]));
+	// Returns the output line (or binary row) for multiplier a
+	auto score = [&](spectral_eval &eval, const ZZ &a) {
+		if (a >= mod) {
+			cerr << "The multiplier must be smaller than the modulus: " << a << endl;
+			exit(1);
+		}
+
+		if (db != NULL && NumBits(a) > 128) {
+			cerr << "Binary output supports multipliers of at most 128 bits: " << a << endl;
+			exit(1);
+		}
+
+		double scores[dim_max + 1];
+		spect_scores(eval, a, max_dim, scores);
+
+		if (db != NULL) {
+			string row;
+			db_row(row, conv<uint128_t>(a), scores, max_dim + 1);
+			return row;
 		}
-		cur_fm[d - 2] = norm[d - 2] * sqrt(min2);
-		min_fm = min(min_fm, cur_fm[d - 2]);
-		harm_score += cur_fm[d - 2] / (d - 1);
-		harm_norm += 1. / (d - 1);
+
+		return spect_line(a, lag, max_dim, scores);
+	};
+
+	if (! batch) {
+		spectral_eval eval(test, fixed, check, incremental, fp, exact);
+		if (fixed && ! exact && ! eval.fixed) cerr << "Modulus too large for fixed-width reduction: using NTL" << endl;
+		const string out = score(eval, strtoZZ(argv[3]));
+		if (db != NULL) {
+			db->add(out);
+			db->flush();
+		}
+		else fputs(out.c_str(), stdout);
+		if (eval.fallbacks != 0) cerr << reduction_name(eval.fixed, fp) << " reduction failed " << eval.fallbacks << " times: used NTL" << endl;
+		return 0;
 	}
 
-	printf("%8.6f\t%8.6f\t", min_fm, harm_score / harm_norm);
-	cout << a << "\t" << "0x" << hex(a) << "\t" << lag;
-	for (int d = 2; d <= max_dim; d++) printf("\t%8.6f", cur_fm[d - 2]);
-	cout << endl;
+	if (fixed && ! exact && ! fixed_reducer(test.mod).usable()) cerr << "Modulus too large for fixed-width reduction: using NTL" << endl;
+
+	/* Each thread reads a batch of lines, scores them, and prints the batch as
+	   soon as all previous batches have been printed. At most two batches per
+	   thread can be waiting to be printed, so memory usage is bounded. */
+	const int batch_size = 1024;
+	mutex m; // Protects the variables below
+	condition_variable printed;
+	int64_t next_batch = 0, next_print = 0, fallbacks = 0, line_number = 0;
+	map<int64_t, string> pending; // Output of completed batches waiting to be printed
+	bool eof = false;
+
+	auto worker = [&]() {
+		spectral_eval eval(test, fixed, check, incremental, fp, exact);
+		vector<ZZ> mults;
+		char *line = NULL;
+		size_t size = 0;
+
+		for(;;) {
+			unique_lock<mutex> lock(m);
+			printed.wait(lock, [&] { return eof || next_batch - next_print < 2 * threads; });
+			if (eof) break;
+			const int64_t k = next_batch++;
+			mults.clear();
+			while (mults.size() < batch_size) {
+				if (getline(&line, &size, stdin) == -1) {
+					eof = true;
+					break;
+				}
+				line_number++;
+				// Extract the requested column
+				char *p = line;
+				for (int c = 1; c < column && *p; c++) {
+					p += strcspn(p, "\t \n");
+					p += strspn(p, "\t ");
+				}
+				p[strcspn(p, "\t \n")] = 0;
+				if (*p == 0) {
+					if (strspn(line, "\t \n") == strlen(line)) continue; // Skip empty lines
+					cerr << "Missing column " << column << " at line " << line_number << endl;
+					exit(1);
+				}
+				mults.push_back(strtoZZ(p));
+			}
+			lock.unlock();
+
+			string out;
+			for (const ZZ &a : mults) out += score(eval, a);
+
+			lock.lock();
+			pending[k] = out;
+			// Print completed batches in order
+			for(auto p = pending.begin(); p != pending.end() && p->first == next_print; p = pending.erase(p), next_print++) {
+				if (db != NULL) db->add(p->second);
+				else fputs(p->second.c_str(), stdout);
+			}
+			fflush(stdout);
+			printed.notify_all();
+		}
+
+		m.lock();
+		fallbacks += eval.fallbacks;
+		m.unlock();
+		free(line);
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+	for (auto &t : pool) t.join();
+	if (db != NULL) db->flush();
+
+	if (fallbacks != 0) cerr << reduction_name(fixed && ! exact && fixed_reducer(test.mod).usable(), fp) << " reduction failed " << fallbacks << " times: used NTL" << endl;
 	return 0;
 }
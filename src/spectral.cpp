@@ -0,0 +1,344 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Figures of merit of the dual lattice of a multiplier, shared by search and
+   spect. A spectral_test contains the parameters of the test (modulus, lag
+   and normalization factors); a spectral_eval contains the state needed to
+   evaluate multipliers, and should be owned by a single thread.
+
+   Must be included after common.cpp and lll.cpp. */
+
+#include <sstream>
+#include <vector>
+
+struct spectral_test {
+	ZZ gen_mod; // The modulus of the generator
+	ZZ mod; // The modulus of the lattice
+	int lag;
+	double norm[dim_max]; // Normalization factors
+	/* Upper bounds on the figures of merit computed from an LLL-reduced
+	   basis, which can be larger than one. If the basis satisfies the Lovász
+	   condition with parameter delta and has Gram-Schmidt coefficients of
+	   absolute value at most eta, its first vector (and thus its shortest
+	   vector) is at most alpha^((d - 1) / 4) mod^(1 / d) long, where alpha =
+	   1 / (delta - eta^2). We use delta = 0.99 and eta = 0.51, which are
+	   satisfied by all reductions. */
+	double max_fm[dim_max];
+
+	spectral_test(const ZZ &gen_mod, int lag, bool mcg) : gen_mod(gen_mod), lag(lag) {
+		// Entacher's characterization of lagged lattices (https://dl.acm.org/doi/10.1145/301677.301682)
+		mod = gen_mod / GCD(gen_mod, conv<ZZ>(lag));
+		// See Knuth TAoCP Vol. 2, 3.3.4, Exercise 20.
+		if (mcg) mod /= 4;
+
+		// Compute the normalization factor starting from gamma_t
+		for(int d = 2; d <= dim_max; d++) {
+			norm[d - 2] = conv<double>(conv<RR>(1) / (pow(conv<RR>(gamma_t[d - 2]), conv<RR>(1./2)) * pow(conv<RR>(mod), conv<RR>(1) / conv<RR>(d))));
+			max_fm[d - 2] = pow(1 / (0.99 - 0.51 * 0.51), (d - 1) / 4.) / sqrt(gamma_t[d - 2]);
+		}
+	}
+
+	// Bits of state of the generator, as recorded in binary output (k for modulus 2^k)
+	int state_bits() const { return NumBits(gen_mod - 1); }
+};
+
+// The name of the approximate reductions in use, for messages, or NULL if lattices are reduced by NTL's exact LLL only.
+inline const char *reduction_name(bool fixed, bool fp) {
+	return fixed ? (fp ? "Fixed-width and floating-point" : "Fixed-width") : fp ? "Floating-point" : NULL;
+}
+
+struct spectral_eval {
+	const spectral_test &t;
+	bool fixed, fp, check, incremental, exact;
+	bool xd; // Whether the floating-point reduction needs the extended exponent of LLL_XD
+	ZZ a, alag; // The multiplier, and its lag-th power
+	/* Workspace for NTL reductions, allocated once and reused for all
+	   multipliers, so that outside of NTL's LLL no memory is allocated in the
+	   steady state: basis[d] is a d x d matrix, and pow[i] is the residue of
+	   alag^i modulo the modulus of the lattice, computed on demand up to
+	   npow. */
+	vector<mat_ZZ> basis;
+	vector<ZZ> pow;
+	int npow;
+	ZZ alag_mod, det2, norm2;
+	int ntl_d; // Dimension of the reduced basis in basis[ntl_d], or zero
+	fixed_reducer fr;
+	/* Workspace for the enumeration of exact mode: the Gram-Schmidt
+	   orthogonalization of the reduced basis (mu and the squared norms c),
+	   the coefficients of the current vector, the current squared radius, the
+	   exponent of the scaling applied to the basis, and the shortest vector
+	   found so far with its exact squared length. */
+	long double mu[dim_max][dim_max], c[dim_max], radius;
+	long x[dim_max];
+	long scale;
+	ZZ coeff, best2;
+	vec_ZZ v;
+	/* Number of failures of the fixed-width or floating-point reduction, and of
+	   differences with NTL in check mode */
+	int64_t fallbacks = 0, mismatches = 0;
+
+	/* If fixed is true, lattices are reduced using fixed-width arithmetic, if
+	   possible (see the fixed field after construction); if fp is true,
+	   lattices that are not reduced using fixed-width arithmetic are reduced
+	   using NTL's floating-point LLL, followed by an exact verification (see
+	   fp_min2()); if check is also true, they are reduced using NTL's exact
+	   LLL, too, and differences are reported. If exact is true, figures of
+	   merit are computed exactly by enumeration on the basis reduced by NTL
+	   (see svp_min2()), and fixed and check are ignored. */
+	spectral_eval(const spectral_test &t, bool fixed, bool check, bool incremental, bool fp = false, bool exact = false) : t(t), fp(fp), incremental(incremental), exact(exact), basis(dim_max + 1), pow(dim_max), npow(0), ntl_d(0), fr(t.mod) {
+		this->fixed = fixed && fr.usable() && ! exact;
+		this->check = check && (this->fixed || fp);
+		// Squared norms must fit a double
+		xd = NumBits(t.mod) > 500;
+		for (int d = 2; d <= dim_max; d++) basis[d].SetDims(d, d);
+	}
+
+
+	/* The lag-th power of the multiplier is computed by NTL only when needed
+	   (see powers()): for power-of-two moduli, the fixed-width reduction uses
+	   NTL just to convert the multiplier. */
+	void multiplier(const ZZ &a) {
+		this->a = a;
+		npow = ntl_d = 0;
+		if (fixed) fr.multiplier(a, t.lag);
+	}
+
+	// Makes pow[0..n) available.
+	void powers(const int n) {
+		if (npow == 0) {
+			rem(alag, a, t.gen_mod);
+			if (t.lag != 1) PowerMod(alag, alag, t.lag, t.gen_mod);
+			rem(alag_mod, alag, t.mod);
+			pow[0] = 1;
+			npow = 1;
+		}
+		for (; npow < n; npow++) MulMod(pow[npow], pow[npow - 1], alag_mod, t.mod);
+	}
+
+	/* Sets up in basis[d] a basis of the dual lattice in dimension d. In
+	   incremental mode, if basis[d - 1] contains a reduced basis, we add a zero
+	   coordinate to all its vectors and append the vector (-a^(d - 1), 0, ...,
+	   0, 1), which yields a basis of the dual lattice in dimension d. */
+	void ntl_basis(const int d) {
+		mat_ZZ &mat = basis[d];
+		powers(d);
+
+		if (incremental && ntl_d == d - 1) {
+			const mat_ZZ &prev = basis[d - 1];
+			for (int i = 0; i < d - 1; i++) {
+				for (int j = 0; j < d - 1; j++) mat[i][j] = prev[i][j];
+				clear(mat[i][d - 1]);
+			}
+			NTL::negate(mat[d - 1][0], pow[d - 1]);
+			for (int j = 1; j < d - 1; j++) clear(mat[d - 1][j]);
+			mat[d - 1][d - 1] = 1;
+		}
+		else {
+			// Dual lattice (see Knuth TAoCP Vol. 2, 3.3.4/B*).
+			for (int i = 0; i < d; i++)
+				for (int j = 0; j < d; j++) clear(mat[i][j]);
+			mat[0][0] = t.mod;
+			for (int i = 1; i < d; i++) {
+				mat[i][i] = 1;
+				NTL::negate(mat[i][0], pow[i]);
+			}
+		}
+	}
+
+	// Squared length of the shortest vector of basis[d].
+	double basis_min2(const int d) {
+		const mat_ZZ &mat = basis[d];
+		double min2 = numeric_limits<double>::infinity();
+		for (int i = 0; i < d; i++) {
+			InnerProduct(norm2, mat[i], mat[i]);
+			min2 = min(min2, conv<double>(norm2));
+		}
+		return min2;
+	}
+
+	// Squared length of the shortest vector of the LLL-reduced dual lattice computed by NTL.
+	double ntl_min2(const int d) {
+		ntl_basis(d);
+		// LLL reduction with delta = 0.999999999
+		LLL(det2, basis[d], 999999999, 1000000000);
+		ntl_d = d;
+		return basis_min2(d);
+	}
+
+	/* Stores in min2 the squared length of the shortest vector of the dual
+	   lattice reduced by NTL's floating-point LLL, which is much faster than
+	   the exact LLL as it keeps the Gram-Schmidt orthogonalization in double
+	   precision (extended-exponent doubles for moduli larger than 2^500).
+	   Precision failures are detected by running the exact LLL on the result,
+	   which is cheap as the basis is already almost reduced: if the shortest
+	   vector changes, false is returned, and the previous state is restored,
+	   so that the caller can fall back to the exact reduction. */
+	bool fp_min2(const int d, double &min2) {
+		const int prev_d = ntl_d;
+		ntl_basis(d);
+		if (xd) LLL_XD(basis[d], 0.999999999);
+		else LLL_FP(basis[d], 0.999999999);
+		min2 = basis_min2(d);
+		LLL(det2, basis[d], 999999999, 1000000000);
+		if (basis_min2(d) != min2) {
+			ntl_d = prev_d;
+			return false;
+		}
+		ntl_d = d;
+		return true;
+	}
+
+	/* Squared length of the shortest nonzero vector of the lattice spanned by
+	   basis[d], which must be LLL-reduced, computed by Schnorr and Euchner's
+	   enumeration (i.e., Fincke and Pohst's algorithm visiting coefficients
+	   in zig-zag order around their center). The Gram-Schmidt
+	   orthogonalization is computed in floating point (scaling the basis so
+	   that squared norms fit a double), but the length of every vector found
+	   is computed exactly, and the radius is enlarged slightly to compensate
+	   for rounding errors, so the result is exact. */
+	double svp_min2(const int d) {
+		const mat_ZZ &mat = basis[d];
+
+		// The shortest vector of the basis is the starting point
+		for (int i = 0; i < d; i++) {
+			InnerProduct(norm2, mat[i], mat[i]);
+			if (i == 0 || norm2 < best2) best2 = norm2;
+		}
+
+		scale = 0;
+		for (int i = 0; i < d; i++)
+			for (int j = 0; j < d; j++) scale = max(scale, NumBits(mat[i][j]) - 500);
+
+		long double bf[dim_max][dim_max];
+		for (int i = 0; i < d; i++)
+			for (int j = 0; j < d; j++) bf[i][j] = scale == 0 ? conv<double>(mat[i][j]) : conv<double>(mat[i][j] >> scale);
+
+		for (int i = 0; i < d; i++) {
+			c[i] = 0;
+			for (int j = 0; j < d; j++) c[i] += bf[i][j] * bf[i][j];
+			for (int j = 0; j < i; j++) {
+				long double r = 0;
+				for (int k = 0; k < d; k++) r += bf[i][k] * bf[j][k];
+				for (int k = 0; k < j; k++) r -= mu[j][k] * mu[i][k] * c[k];
+				mu[i][j] = r / c[j];
+				c[i] -= mu[i][j] * mu[i][j] * c[j];
+			}
+		}
+
+		set_radius();
+		v.SetLength(d);
+		enumerate(d, d - 1, 0, true);
+		return conv<double>(best2);
+	}
+
+	// Sets the radius of the enumeration from best2.
+	void set_radius() {
+		radius = conv<double>(scale == 0 ? best2 : best2 >> 2 * scale) * (1 + 1E-9L);
+	}
+
+	/* Enumerates the coefficients x[0..i] given x[i + 1..d), where partial is
+	   the squared length of the projection of the vector so far orthogonally
+	   to the first i + 1 vectors of the Gram-Schmidt basis. If top is true,
+	   all coefficients above i are zero, and only nonnegative values of x[i]
+	   are considered, as v and -v have the same length. */
+	void enumerate(const int d, const int i, const long double partial, const bool top) {
+		long double center = 0;
+		for (int j = i + 1; j < d; j++) center -= x[j] * mu[j][i];
+		const long double r = roundl(center);
+
+		for (int dir = 1; dir >= (top ? 1 : -1); dir -= 2)
+			for (long double xi = dir == 1 ? r : r - 1;; xi += dir) {
+				const long double y = xi - center, l = partial + y * y * c[i];
+				if (l > radius) break;
+				x[i] = xi;
+				if (i > 0) enumerate(d, i - 1, l, top && xi == 0);
+				else if (! (top && xi == 0)) leaf(d);
+			}
+
+		x[i] = 0;
+	}
+
+	// Computes exactly the squared length of the vector with coefficients x[0..d), updating best2.
+	void leaf(const int d) {
+		const mat_ZZ &mat = basis[d];
+		for (int j = 0; j < d; j++) clear(v[j]);
+		for (int i = 0; i < d; i++) {
+			if (x[i] == 0) continue;
+			conv(coeff, x[i]);
+			for (int j = 0; j < d; j++) MulAddTo(v[j], mat[i][j], coeff);
+		}
+		InnerProduct(norm2, v, v);
+		if (norm2 < best2) {
+			best2 = norm2;
+			set_radius();
+		}
+	}
+
+	// Returns the figure of merit in dimension d of the current multiplier.
+	double fm(const int d) {
+		const int prev_d = ntl_d;
+		const char *method = NULL; // The approximate method used, if any
+		double min2;
+
+		if (fixed && fr.min2(d, min2, incremental)) method = "fixed-width";
+		else {
+			if (fixed) fallbacks++;
+			if (fp && fp_min2(d, min2)) method = "floating-point";
+			else {
+				if (fp) fallbacks++;
+				min2 = ntl_min2(d);
+			}
+		}
+
+		if (check && method != NULL) {
+			ntl_d = prev_d;
+			const double ntl = ntl_min2(d);
+			if (fabs(sqrt(ntl) - sqrt(min2)) > 1E-12 * sqrt(ntl)) {
+				mismatches++;
+				ostringstream s;
+				s << "Mismatch for multiplier " << a << " (lag " << t.lag << ") in dimension " << d << ": " << t.norm[d - 2] * sqrt(min2) << " (" << method << ") != " << t.norm[d - 2] * sqrt(ntl) << " (NTL)" << endl;
+				cerr << s.str();
+			}
+			min2 = ntl;
+		}
+
+		if (exact) min2 = svp_min2(d);
+
+		return t.norm[d - 2] * sqrt(min2);
+	}
+};
+
+/* Computes the figures of merit of multiplier a up to dimension max_dim,
+   storing in scores the minimum spectral score, the harmonic spectral score
+   and the figures of merit (max_dim + 1 values), as printed by spect. */
+inline void spect_scores(spectral_eval &eval, const ZZ &a, const int max_dim, double * const scores) {
+	double harm_norm = 0, min_fm = numeric_limits<double>::infinity(), harm_score = 0;
+	eval.multiplier(a);
+	for (int d = 2; d <= max_dim; d++) {
+		const double fm = scores[d] = eval.fm(d);
+		harm_norm += 1. / (d - 1);
+		min_fm = min(min_fm, fm);
+		harm_score += fm / (d - 1);
+	}
+	scores[0] = min_fm;
+	scores[1] = harm_score / harm_norm;
+}
+
+// The line printed by spect for multiplier a at the given lag, with scores computed by spect_scores().
+inline string spect_line(const ZZ &a, const int lag, const int max_dim, const double * const scores) {
+	char buf[32];
+	ostringstream out;
+	snprintf(buf, sizeof buf, "%8.6f\t%8.6f\t", scores[0], scores[1]);
+	out << buf << a << "\t" << "0x" << hex(a) << "\t" << lag;
+	for (int d = 2; d <= max_dim; d++) {
+		snprintf(buf, sizeof buf, "\t%8.6f", scores[d]);
+		out << buf;
+	}
+	out << "\n";
+	return out.str();
+}
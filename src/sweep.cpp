@@ -0,0 +1,478 @@
+/*  Written in 2019-2021 by Guy Steele and Sebastiano Vigna
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Runs a sweep of searches for multipliers (e.g., all types and sizes of
+   ../python/filterall.sh) in a single process. Each line of the job file
+   specifies a configuration TYPE-STATE-BITS (LCG or MCG, bits of state,
+   multiplier size) and its number of candidates, with the same meaning of
+   ITERS in search; the output of each configuration is written to its own
+   file, and it is identical to that of
+
+   search SEED MAXDIM 2^STATE BITS ITERS
+
+   (msearch for MCGs) with the same options, as blocks are evaluated by the
+   same code (see evaluate.cpp), using the same generators.
+
+   Blocks are evaluated by a pool of threads with work stealing: every
+   thread owns a deque of ranges of blocks (initially, the full range of
+   each configuration is assigned to a thread), and evaluates the first
+   block of the range at the back of its deque, pushing back the rest; a
+   thread with an empty deque steals the first steal_blocks blocks of the
+   range at the front of the deque of another thread. In this way, no core
+   stays idle until the whole sweep is finished, even if configurations have
+   very different costs. Since blocks are printed in order, and stolen
+   blocks are the first ones not taken yet, the number of completed blocks
+   waiting to be printed is bounded by a small multiple of steal_blocks
+   times the number of threads. */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <NTL/LLL.h>
+
+using namespace NTL;
+using namespace std;
+#include "common.cpp"
+#include "lll.cpp"
+#include "spectral.cpp"
+#include "dbformat.cpp"
+#include "candidates.cpp"
+#include "evaluate.cpp"
+
+// Blocks stolen at a time by a thread with an empty deque
+const int64_t steal_blocks = 4;
+
+// Output and counts of a completed block waiting to be printed (the statistics of search are not kept)
+struct job_block {
+	string out;
+	int64_t evaluated, accepted, fallbacks, mismatches, pruned;
+};
+
+// A configuration of the sweep
+struct job {
+	string name;
+	int64_t blocks;
+	unique_ptr<block_evaluator> ev;
+	FILE *out;
+	db_writer *db = NULL;
+
+	// Protected by the output mutex
+	int64_t next_print = 0;
+	map<int64_t, job_block> pending; // Completed blocks waiting to be printed
+	int64_t evaluated = 0, accepted = 0, fallbacks = 0, mismatches = 0, pruned = 0;
+	double cpu = 0; // Thread CPU time spent evaluating blocks, in seconds
+};
+
+// A range [first..end) of blocks of a job, and the generator for block first
+struct block_range {
+	int job;
+	int64_t first, end;
+	xoshiro256 gen;
+};
+
+// The deque of ranges owned by a thread
+struct work_queue {
+	mutex m;
+	deque<block_range> ranges;
+};
+
+static double thread_cpu_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+int main(int argc, char *argv[]) {
+
+	search_options o;
+	int threads = 1, strategy = -1, opt;
+	const char *dim_order = NULL, *dir = ".";
+
+	static const struct option options[] = {
+		{ "binary", optional_argument, NULL, 'b' },
+		{ "generator", required_argument, NULL, 'g' },
+		{ "top", required_argument, NULL, 'H' },
+		{ "top-min", required_argument, NULL, 'M' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "+j:pd:fFcil:o:g:", options, NULL)) != -1) {
+		switch (opt) {
+		case 'H':
+		case 'M':
+			(opt == 'H' ? o.top_harm : o.top_min) = strtoll(optarg, NULL, 0);
+			if ((opt == 'H' ? o.top_harm : o.top_min) < 1) {
+				cerr << "The number of candidates to keep must be strictly positive" << endl;
+				exit(1);
+			}
+			break;
+		case 'b':
+			o.score_bytes = optarg == NULL ? 4 : atoi(optarg);
+			if (o.score_bytes != 4 && o.score_bytes != 8) {
+				cerr << "Scores can be stored using 4 or 8 bytes" << endl;
+				exit(1);
+			}
+			break;
+		case 'g':
+			strategy = strategy_by_name(optarg);
+			if (strategy == -1) {
+				cerr << "Unknown candidate generator: " << optarg << endl;
+				exit(1);
+			}
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads <= 0) threads = thread::hardware_concurrency();
+			break;
+		case 'p':
+			o.prune = true;
+			break;
+		case 'd':
+			dim_order = optarg;
+			break;
+		case 'i':
+			o.incremental = true;
+			break;
+		case 'l':
+			o.lags = atoi(optarg);
+			if (o.lags < 1) {
+				cerr << "The number of lags must be strictly positive" << endl;
+				exit(1);
+			}
+			break;
+		case 'o':
+			dir = optarg;
+			break;
+		case 'F':
+			o.fp = true;
+			break;
+		case 'c':
+			o.check = true;
+			// fall through
+		case 'f':
+			o.fixed = true;
+			break;
+		default:
+			exit(1);
+		}
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != 4) {
+		cerr << "USAGE: " << argv[0] << " [-j THREADS] [-o DIR] [-p] [-d ORDER] [-f | -c] [-F] [-i] [-l LAGS] [--binary[=BYTES]] [-g GENERATOR] [--top K] [--top-min K] SEED MAXDIM JOBFILE" << endl << endl;
+		cerr << "Searches for multipliers with good spectral properties for all the" << endl;
+		cerr << "configurations listed in JOBFILE using a single pool of threads." << endl;
+		cerr << "Each line of JOBFILE (empty lines and lines starting with # are" << endl;
+		cerr << "ignored) has the form TYPE-STATE-BITS ITERS, where TYPE is LCG or" << endl;
+		cerr << "MCG, STATE is the number of bits of state (the modulus is 2^STATE)," << endl;
+		cerr << "BITS is the multiplier size and ITERS is the number of candidates," << endl;
+		cerr << "with the same meaning as in search (if ITERS is negative, -ITERS" << endl;
+		cerr << "multipliers are tested starting from SEED * 8 + 5). The output of" << endl;
+		cerr << "each configuration is written to the file TYPE-STATE-BITS (or" << endl;
+		cerr << "TYPE-STATE-BITS-L if LAGS is larger than one) in DIR (default: the" << endl;
+		cerr << "current directory), and it is identical to the output of search" << endl;
+		cerr << "(msearch for MCGs) with the same SEED, MAXDIM, options and" << endl;
+		cerr << "parameters. The other options have the same meaning as in search;" << endl;
+		cerr << "in top-K mode, each configuration keeps its best candidates." << endl;
+		cerr << "Blocks of " << block_size << " candidates are evaluated by the given number of" << endl;
+		cerr << "threads (0 means all available cores) with work stealing, so that" << endl;
+		cerr << "all threads are busy until the whole sweep is finished. At the" << endl;
+		cerr << "end, the number of candidates evaluated and accepted, the CPU time" << endl;
+		cerr << "and the number of accepted multipliers per CPU-hour of each" << endl;
+		cerr << "configuration are printed on standard error." << endl;
+		exit(1);
+	}
+
+	char *end = NULL;
+	const uint64_t seed = o.seed = strtoll(argv[1], &end, 0);
+	if (*end) {
+		cerr << "Unreadable seed: " << argv[1] << endl;
+		exit(1);
+	}
+
+	const int max_dim = o.max_dim = strtoll(argv[2], &end, 0);
+	if (*end) {
+		cerr << "Unreadable maximum dimension: " << argv[2] << endl;
+		exit(1);
+	}
+
+	if (max_dim > dim_max) {
+		cerr << "Maximum possible number of dimensions: " << dim_max << endl;
+		exit(1);
+	}
+
+	if (max_dim < 2) {
+		cerr << "Minimum possible number of dimensions: 2" << endl;
+		exit(1);
+	}
+
+	o.set_order(dim_order);
+
+	ifstream in(argv[3]);
+	if (! in) {
+		perror(argv[3]);
+		exit(1);
+	}
+
+	// Jobs are parsed completely before opening any output file
+
+	vector<job> jobs;
+	int line_number = 0;
+	for (string line; getline(in, line); ) {
+		line_number++;
+		istringstream s(line);
+		string name, count;
+		if (! (s >> name) || name[0] == '#') continue;
+		char type[4];
+		int state, multiplier_size;
+		char c;
+		if (! (s >> count) || (s >> c) || sscanf(name.c_str(), "%3[A-Z]-%d-%d%c", type, &state, &multiplier_size, &c) != 3 || (strcmp(type, "LCG") != 0 && strcmp(type, "MCG") != 0)) {
+			cerr << "Invalid job at line " << line_number << " of " << argv[3] << ": " << line << endl;
+			exit(1);
+		}
+
+		if (state < 1 || multiplier_size < 1 || multiplier_size > state) {
+			cerr << "Invalid multiplier size or state for " << name << endl;
+			exit(1);
+		}
+
+		if (o.score_bytes != 0 && multiplier_size > 128) {
+			cerr << "Binary output supports multipliers of at most 128 bits: " << name << endl;
+			exit(1);
+		}
+
+		int64_t iters = strtoll(count.c_str(), &end, 0);
+		if (*end) {
+			cerr << "Unreadable number of iterations for " << name << ": " << count << endl;
+			exit(1);
+		}
+
+		// A negative number of iterations implies an exhaustive search
+		candidate_strategy job_strategy = strategy == -1 ? UNIFORM : (candidate_strategy)strategy;
+		if (iters < 0) {
+			if (strategy != -1 && strategy != EXHAUSTIVE) {
+				cerr << "A negative number of iterations requires an exhaustive search: " << name << endl;
+				exit(1);
+			}
+			job_strategy = EXHAUSTIVE;
+			iters = -iters;
+		}
+
+		job j;
+		j.name = name;
+		j.blocks = iters == 0 ? 0 : (iters - 1) / block_size + 1;
+		j.ev.reset(new block_evaluator(o, conv<ZZ>(1) << state, strcmp(type, "MCG") == 0, multiplier_size, iters, job_strategy));
+		jobs.push_back(move(j));
+	}
+
+	if (jobs.empty()) {
+		cerr << "No jobs in " << argv[3] << endl;
+		exit(1);
+	}
+
+	for (auto &j : jobs) {
+		const string file = string(dir) + "/" + j.name + (o.lags > 1 ? "-L" : "");
+		j.out = fopen(file.c_str(), "w");
+		if (j.out == NULL) {
+			perror(file.c_str());
+			exit(1);
+		}
+		if (o.score_bytes != 0) j.db = new db_writer(j.out, j.ev->header());
+		if (o.fixed && ! j.ev->fixed()) cerr << j.name << ": modulus too large for fixed-width reduction: using NTL" << endl;
+	}
+
+	cerr << "Seed: 0x" << hex << seed << endl;
+	cerr << "Maximum dimension: " << dec << max_dim << endl;
+	cerr << "Jobs: " << jobs.size() << endl;
+	cerr << "Threads: " << threads << endl;
+	cerr << "Dimension order:";
+	for (int i = 0; i < max_dim - 1; i++) cerr << " " << o.order[i];
+	cerr << (o.prune ? " (pruning)" : "") << endl;
+	cerr << "Reduction: " << (o.fixed ? (o.fp ? "fixed-width, floating-point" : "fixed-width") : o.fp ? "floating-point" : "NTL") << (o.incremental ? ", incremental" : "") << (o.check ? " (checked against NTL)" : "") << endl;
+	if (o.lags > 1) cerr << "Lags: 1-" << o.lags << endl;
+	if (o.top_harm != 0) cerr << "Keeping the best " << o.top_harm << " candidates by harmonic score" << endl;
+	if (o.top_min != 0) cerr << "Keeping the best " << o.top_min << " candidates by minimum score" << endl;
+
+	// The full range of each job is initially assigned to a thread
+	vector<work_queue> queues(threads);
+	atomic<int64_t> unclaimed(0); // Blocks not yet taken by a thread for evaluation
+	for (int i = 0; i < (int)jobs.size(); i++) {
+		if (jobs[i].blocks == 0) continue;
+		block_range r = { i, 0, jobs[i].blocks, xoshiro256() };
+		r.gen.init(seed << 8 | jobs[i].ev->multiplier_size);
+		queues[i % threads].ranges.push_back(r);
+		unclaimed += jobs[i].blocks;
+	}
+
+	mutex m; // Protects the printing state of jobs
+	int completed = 0;
+	const auto start_time = chrono::steady_clock::now();
+
+	auto elapsed = [&]() { return chrono::duration<double>(chrono::steady_clock::now() - start_time).count(); };
+
+	// The evaluators and the candidate generator of a thread for a job
+	struct job_state {
+		vector<spectral_eval> evals;
+		candidate_generator cg;
+	};
+
+	/* Takes a block to evaluate for thread t: the first block of the range at
+	   the back of its deque, or, if its deque is empty, the first of the first
+	   steal_blocks blocks of the range at the front of the deque of another
+	   thread, whose other blocks are pushed on the deque of t. Returns false
+	   if there is no block left. */
+	auto take = [&](const int t, int &i, int64_t &k, xoshiro256 &r) {
+		for(;;) {
+			if (unclaimed == 0) return false;
+
+			work_queue &q = queues[t];
+			q.m.lock();
+			if (! q.ranges.empty()) {
+				block_range &b = q.ranges.back();
+				i = b.job;
+				k = b.first++;
+				r = b.gen;
+				if (b.first == b.end) q.ranges.pop_back();
+				else if (jobs[i].ev->strategy != EXHAUSTIVE) b.gen.jump();
+				unclaimed--;
+				q.m.unlock();
+				return true;
+			}
+			q.m.unlock();
+
+			for (int v = (t + 1) % threads; v != t; v = (v + 1) % threads) {
+				work_queue &w = queues[v];
+				w.m.lock();
+				if (w.ranges.empty()) {
+					w.m.unlock();
+					continue;
+				}
+				block_range s = w.ranges.front(); // s.gen is the generator of block s.first
+				s.end = min(s.end, s.first + steal_blocks);
+				if (s.end == w.ranges.front().end) w.ranges.pop_front();
+				else {
+					block_range &rest = w.ranges.front();
+					rest.first = s.end;
+					if (jobs[s.job].ev->strategy != EXHAUSTIVE) for (int64_t n = s.first; n < s.end; n++) rest.gen.jump();
+				}
+				w.m.unlock();
+
+				i = s.job;
+				k = s.first++;
+				r = s.gen;
+				unclaimed--;
+				if (s.first != s.end) {
+					if (jobs[i].ev->strategy != EXHAUSTIVE) s.gen.jump();
+					q.m.lock();
+					q.ranges.push_back(s);
+					q.m.unlock();
+				}
+				return true;
+			}
+
+			// Blocks are being moved between deques, or are being evaluated
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	};
+
+	auto worker = [&](const int t) {
+		map<int, job_state> states; // Created lazily, when a thread evaluates a block of a job for the first time
+		xoshiro256 r;
+		block_result res;
+		int i;
+		int64_t k;
+
+		while (take(t, i, k, r)) {
+			job &j = jobs[i];
+			auto s = states.find(i);
+			if (s == states.end()) s = states.emplace(i, job_state{ j.ev->evals(), j.ev->generator() }).first;
+
+			const double start_cpu = thread_cpu_time();
+			j.ev->evaluate(s->second.evals, s->second.cg, k, r, res);
+			const double cpu = thread_cpu_time() - start_cpu;
+
+			m.lock();
+			j.pending[k] = { move(res.out), res.evaluated, res.accepted, res.fallbacks, res.mismatches, res.pruned };
+			j.cpu += cpu;
+			// Print completed blocks in order
+			for(auto p = j.pending.begin(); p != j.pending.end() && p->first == j.next_print; p = j.pending.erase(p), j.next_print++) {
+				const job_block &b = p->second;
+				if (j.db != NULL) j.db->add(b.out);
+				else fputs(b.out.c_str(), j.out);
+				j.evaluated += b.evaluated;
+				j.accepted += b.accepted;
+				j.fallbacks += b.fallbacks;
+				j.mismatches += b.mismatches;
+				j.pruned += b.pruned;
+			}
+			if (j.next_print == j.blocks) {
+				char buf[256];
+				snprintf(buf, sizeof buf, "Completed %s (%d/%d) at %.0f s: %lld accepted", j.name.c_str(), ++completed, (int)jobs.size(), elapsed(), (long long)j.accepted);
+				cerr << buf;
+				if (o.top()) {
+					// All blocks of the job have been evaluated, so the heaps are final
+					const map<int64_t, string> kept = j.ev->kept();
+					for (const auto &e : kept) {
+						if (j.db != NULL) j.db->add(e.second);
+						else fputs(e.second.c_str(), j.out);
+					}
+					cerr << ", " << kept.size() << " kept";
+				}
+				cerr << endl;
+				if (j.db != NULL) j.db->flush();
+			}
+			fflush(j.out);
+			m.unlock();
+		}
+	};
+
+	vector<thread> pool;
+	for (int t = 0; t < threads; t++) pool.emplace_back(worker, t);
+	for (auto &t : pool) t.join();
+
+	char buf[256];
+	int64_t evaluated = 0, accepted = 0;
+	cerr << "#config\tevaluated\taccepted\tCPU time (s)\taccepted/CPU-hour" << endl;
+	for (auto &j : jobs) {
+		delete j.db;
+		fclose(j.out);
+		evaluated += j.evaluated;
+		accepted += j.accepted;
+		snprintf(buf, sizeof buf, "%s\t%lld\t%lld\t%.3f\t%.1f", j.name.c_str(), (long long)j.evaluated, (long long)j.accepted, j.cpu, j.cpu > 0 ? j.accepted / (j.cpu / 3600) : 0.);
+		cerr << buf << endl;
+		if (j.fallbacks != 0) cerr << j.name << ": " << reduction_name(j.ev->fixed(), o.fp) << " reduction failures: " << j.fallbacks << endl;
+		if (o.check) cerr << j.name << ": mismatches with NTL: " << j.mismatches << endl;
+		if (j.ev->top_prune) cerr << j.name << ": stopped by the top-K bars: " << j.pruned << endl;
+	}
+
+	const double e = elapsed();
+	struct rusage u;
+	getrusage(RUSAGE_SELF, &u);
+	const double cpu = u.ru_utime.tv_sec + u.ru_stime.tv_sec + (u.ru_utime.tv_usec + u.ru_stime.tv_usec) / 1E6;
+	cerr << "Evaluated: " << evaluated << endl;
+	cerr << "Accepted: " << accepted << endl;
+	snprintf(buf, sizeof buf, "Elapsed time: %.3f s (%.1f candidates/s)", e, evaluated / e);
+	cerr << buf << endl;
+	snprintf(buf, sizeof buf, "CPU time: %.3f s (%.1f%% utilization of %d threads)", cpu, e > 0 ? 100 * cpu / (e * threads) : 0., threads);
+	cerr << buf << endl;
+}
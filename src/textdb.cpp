@@ -0,0 +1,110 @@
+/*  Written in 2019-2021 by Sebastiano Vigna (vigna@acm.org)
+
+To the extent possible under law, the author has dedicated all copyright
+and related and neighboring rights to this software to the public domain
+worldwide. This software is distributed without any warranty.
+
+See <http://creativecommons.org/publicdomain/zero/1.0/>. */
+
+/* Fast access to text databases, shared by filter and gensel. Files are
+   memory mapped, and lines are split using memchr(), which is vectorized by
+   the C library. Scores are parsed as fixed-point numbers with six decimal
+   places, which is the precision of the text format.
+
+   Must be included after using namespace std. */
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A memory-mapped text file, read line by line
+struct text_file {
+	string name;
+	const char *base, *p, *end;
+	size_t size;
+	int64_t line_number = 0;
+
+	text_file(const string &name) : name(name) {
+		const int fd = open(name.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd == -1 || fstat(fd, &st) == -1) {
+			perror(name.c_str());
+			exit(1);
+		}
+		size = st.st_size;
+		base = size == 0 ? NULL : (const char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED) {
+			perror(name.c_str());
+			exit(1);
+		}
+		madvise((void *)base, size, MADV_SEQUENTIAL);
+		close(fd);
+		p = base;
+		end = base + size;
+	}
+
+	// Restarts reading from the first line.
+	void rewind() {
+		p = base;
+		line_number = 0;
+	}
+
+	~text_file() { if (base != NULL) munmap((void *)base, size); }
+
+	text_file(const text_file &) = delete;
+
+	// Sets [s..e) to the next line (without the newline); returns false at end of file.
+	bool next(const char *&s, const char *&e) {
+		if (p == end) return false;
+		s = p;
+		e = (const char *)memchr(p, '\n', end - p);
+		if (e == NULL) e = end;
+		p = e == end ? end : e + 1;
+		line_number++;
+		return true;
+	}
+
+	void error(const char * const what) {
+		cerr << name << ":" << line_number << ": " << what << endl;
+		exit(1);
+	}
+};
+
+// Splits [s..e) at TABs, storing the start of each field (the end of field i is field[i + 1] - 1, or e for the last field).
+inline void split(const char *s, const char * const e, vector<const char *> &field) {
+	field.clear();
+	field.push_back(s);
+	while ((s = (const char *)memchr(s, '\t', e - s)) != NULL) field.push_back(++s);
+}
+
+/* Parses a nonnegative score with at most six decimal places as an integer
+   number of millionths; returns -1 if the score is not in this format
+   (e.g., if the field is empty). */
+inline int64_t parse_score(const char *s, const char * const e) {
+	while (s < e && *s == ' ') s++;
+	int64_t x = 0;
+	int decimals = -1;
+	bool digits = false;
+	for (; s < e; s++) {
+		if (*s == '.' && decimals < 0) decimals = 0;
+		else if (*s >= '0' && *s <= '9' && decimals < 6) {
+			x = x * 10 + (*s - '0');
+			if (decimals >= 0) decimals++;
+			digits = true;
+		}
+		else return -1;
+	}
+	if (! digits) return -1;
+	for (decimals = max(decimals, 0); decimals < 6; decimals++) x *= 10;
+	return x;
+}
+
+// Appends a score in millionths as %f does.
+inline char *print_score(char *b, const int64_t x) {
+	b += sprintf(b, "%lld.%06lld", (long long)(x / 1000000), (long long)(x % 1000000));
+	return b;
+}